@@ -120,11 +120,12 @@ paddr_t ram_getfirstfree_(void);
  * We'll take up to 16 invalidations before just flushing the whole TLB.
  */
 
+struct addrspace;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	struct addrspace *ts_as;	/* address space owning the mapping */
+	unsigned int ts_id;		/* id of ts_as in the software TLB */
+	vaddr_t ts_vaddr;		/* page to invalidate */
 };
 
 #define TLBSHOOTDOWN_MAX 16
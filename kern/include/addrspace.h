@@ -36,11 +36,14 @@
 
 
 #include <vm.h>
+#include <spinlock.h>
 #include "opt-dumbvm.h"
 #include "opt-pt.h"
 #include "pt.h"
 #include "segment.h"
+#include "tlb.h"
 #include "opt-ondemand.h"
+#include "opt-ipt.h"
 
 struct vnode;
 
@@ -71,10 +74,19 @@ struct addrspace {
         paddr_t as_stackpbase;
         
 #elif OPT_PT	/* PAGINAZIONE */
-	pt_entry* pt;
-	segment_entry* segments;
+#if !OPT_IPT
+	pagetable* pt;			// con OPT_IPT le pagine in memoria sono nella page table invertita della coremap
+#endif
+	segment_table segments;		// segmenti ordinati per indirizzo, con cache dell'ultimo trovato
 	struct vnode* elf_file;
 	vaddr_t heap_start,heap_end; 
+	unsigned int resident;		// numero di frame in memoria, protetto da frames_lock, usato come riserva dalla politica di rimpiazzamento globale
+	unsigned int evicting;		// pagine di questo as in fase di swap out da parte di altri processi
+	int frames;			// primo frame della lista dei frame in memoria (coremap[].as_next), -1 se vuota
+	struct spinlock frames_lock;	// protegge la lista frames
+	unsigned int stlb_id;		// id dell'as nella tlb software per-CPU (vedi tlb.h), mai riusato
+	struct tlb_asid asid[MAXCPUS];	// ASID dell'as su ciascuna CPU, con la generazione in cui è stato assegnato
+	int swap_slots;			// primo slot della lista degli slot nello swapfile (protetta dal lock dello swap), -1 se vuota
 	
 #endif
 };
@@ -133,12 +145,13 @@ int               as_define_region(struct addrspace *as,
                                    int executable);
 #else
 /*
-* Riceve come parametro aggiuntivo l'offset del segmento nel file elf. Serve per la gestione dei page fault.
+* Riceve come parametri aggiuntivi l'offset del segmento nel file elf e la sua dimensione nel file. Servono per la gestione
+* dei page fault: le pagine oltre filesz (bss) vengono azzerate senza leggere l'elf.
 * Alloca un segmento con le informazioni lette dal file elf. Alloca la porzione di page table asspciata a quel segmento.
 */
 int               as_define_region(struct addrspace *as, 
                                    vaddr_t vaddr, off_t offset,
-                                   size_t sz,
+                                   size_t sz, size_t filesz,
                                    int readable,
                                    int writeable,
                                    int executable);
@@ -159,10 +172,11 @@ void 		  as_zero_region(paddr_t paddr, unsigned npages);
  *               address space. Returns the entry point (initial PC)
  *               in the space pointed to by ENTRYPOINT.
  *
- *    load_page_from_elf - Carica una singola pagina dal file elf con lettura ad accesso diretto.
+ *    load_page_from_elf - Carica una singola pagina dal file elf con lettura ad accesso diretto, all'indirizzo di
+ *                         kernel del frame.
  */
 
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
-int load_page_from_elf(struct addrspace *as, vaddr_t vaddr, off_t offset, size_t memsize, size_t filesize,int is_executable);
+int load_page_from_elf(struct addrspace *as, vaddr_t kvaddr, off_t offset, size_t memsize, size_t filesize);
 
 #endif /* _ADDRSPACE_H_ */
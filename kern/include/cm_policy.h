@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _CM_POLICY_H_
+#define _CM_POLICY_H_
+
+#include <types.h>
+#include <addrspace.h>
+
+#define CM_POLICY_DEFAULT "fifo"
+#define WSCLOCK_TAU 64		// finestra del working set per WSClock, misurata in pagine caricate
+#define CM_POLICY_STATS 4	// contatori REPL_HIT, REPL_MISS, REPL_SECOND_CHANCE, REPL_GHOST_HIT di ogni politica
+
+/*
+ * Politica di rimpiazzamento - data structure
+ *
+ *	Ogni politica è descritta da una struct cm_policy. Tutte le funzioni tranne prepare sono chiamate da coremap.c
+ *	con cm_lock acquisito; quelle che la politica non usa possono essere NULL.
+ *
+ *	prepare	- Chiamata senza cm_lock prima di attivare la politica. Può allocare memoria.
+ *	start	- Costruisce lo stato della politica a partire dai frame già in memoria.
+ *	select	- Sceglie la vittima tra i frame candidati per as (vedi cm_is_candidate). Restituisce -1 se non c'è.
+ *	map	- Il frame contiene una pagina appena caricata ed è diventato CLEAN o DIRTY.
+ *	unmap	- Il frame è stato liberato senza essere scelto come vittima.
+ *	asfree	- L'address space è stato distrutto.
+ *
+ *	stats contiene i contatori REPL_* (vedi vm_stats.h) accumulati mentre la politica era attiva: con vmpolicy si
+ *	può cambiare politica a runtime e i totali di vm_stats mescolerebbero politiche diverse. Aggiornati da
+ *	cm_policy_stat sotto policy_stats_lock.
+ */
+
+struct cm_policy{
+	const char* name;
+	int (*prepare)(void);
+	void (*start)(void);
+	int (*select)(struct addrspace* as);
+	void (*map)(unsigned int pos);
+	void (*unmap)(unsigned int pos);
+	void (*asfree)(struct addrspace* as);
+	unsigned int stats[CM_POLICY_STATS];
+};
+
+/*
+ * Functions in cm_policy.c:
+ *
+ *    cm_policy_lookup	- Cerca una politica per nome ("fifo", "clock", "wsclock", "car"). Restituisce NULL se non esiste.
+ *    cm_policy_list	- Stampa i nomi delle politiche disponibili.
+ *    cm_policy_shutdown - Dealloca le strutture allocate dalle politiche. Chiamata da cm_shutdown.
+ *    cm_policy_print_stats - Stampa i contatori REPL_* di ciascuna politica che è stata attiva. Chiamata da cm_print_stats.
+ */
+
+struct cm_policy* cm_policy_lookup(const char* name);
+void cm_policy_list(void);
+void cm_policy_shutdown(void);
+void cm_policy_print_stats(void);
+
+#endif /* _CM_POLICY_H_ */
@@ -40,9 +40,61 @@
 #include <spl.h>
 #include <cpu.h>
 #include <spinlock.h>
+#include <platform/maxcpus.h>
+#include "opt-ipt.h"
+#include "opt-ondemand.h"
+
+#if OPT_IPT && !OPT_ONDEMAND
+#error "ipt option requires ondemand"
+#endif
 
 #define SWAP_TEST 0
 #define NUM_FREEFRAMES_TEST 17 // palin 17
+#define CM_MAX_ORDER 10		// ordine massimo del buddy allocator: blocchi fino a 1024 frame (4MB)
+#define CM_MAGAZINES 1		// 0 per disabilitare le magazine per-CPU (tutte le allocazioni passano da cm_lock)
+#define CM_MAG_SIZE 16		// frame contenuti al massimo in una magazine
+#define CM_MAG_BATCH 8		// frame trasferiti tra magazine e buddy allocator con una sola acquisizione di cm_lock
+
+/*
+ * Politiche di rimpiazzamento: con CM_REPL_LOCAL la vittima viene scelta tra i frame del processo che ha causato il
+ * page fault, con CM_REPL_GLOBAL tra i frame di tutti i processi. Con politica globale un processo non perde frame se
+ * ne ha CM_MIN_RESIDENT o meno, così che un processo non possa sottrarre tutta la memoria agli altri.
+ */
+#define CM_REPL_LOCAL 0
+#define CM_REPL_GLOBAL 1
+#define CM_REPL_DEFAULT CM_REPL_GLOBAL
+#define CM_MIN_RESIDENT 4
+
+/*
+ * Bit di riferimento software: ogni CM_REFSWEEP_TICKS hardclock (HZ=100) ciascuna CPU azzera il bit delle pagine del
+ * processo in esecuzione presenti nella propria tlb e toglie TLBLO_VALID alle loro entry. Il successivo accesso alla pagina
+ * trova la entry non valida e passa da vm_fault (non dal refill in assembly), che rialza il bit.
+ * Con 0 lo sweep è disabilitato e il bit viene alzato solo dai fault gestiti in C.
+ */
+#define CM_REFSWEEP_TICKS 25
+
+/*
+ * Pageout daemon: viene svegliato quando i frame liberi (buddy allocator e magazine) scendono sotto CM_FREE_LOW e libera vittime,
+ * scrivendo nello swapfile quelle DIRTY, finché i frame liberi non raggiungono CM_FREE_HIGH. Tra un blocco di
+ * CM_PAGEOUT_BATCH vittime e il successivo cede la CPU ai processi.
+ */
+#define CM_FREE_LOW 8
+#define CM_FREE_HIGH 16
+#define CM_PAGEOUT_BATCH 8
+
+/*
+ * Pool di frame azzerati in anticipo da un thread di kernel (pagezero), usato da frame_alloc per le pagine che devono
+ * partire azzerate (stack, bss, heap, ultima pagina parziale di un segmento). Il thread riempie il pool fino a
+ * CM_ZERO_POOL frame quando scende sotto la metà, ma solo se ci sono almeno CM_FREE_HIGH frame liberi.
+ */
+#define CM_ZERO_POOL 32
+
+/*
+ * Page table invertita (OPT_IPT): le pagine in memoria si cercano con una tabella hash su (as, vpn) le cui catene sono
+ * collegate tramite le entry della coremap. La tabella ha una testa per ogni frame (arrotondato alla potenza di 2),
+ * quindi la memoria occupata non dipende dal numero né dalla dimensione dei processi.
+ */
+#define IPT_HASH(as, vaddr, mask) (((((vaddr) >> 12) ^ ((unsigned int)(as) >> 4)) * 2654435761U >> 8) & (mask))
 
 
 /*
@@ -51,13 +103,21 @@
  *	     frame_state:  spiegare gli stati dei frame
  *	     cm_entry:  will keep info about a frame in ram.
  *
+ *	     I frame FREE sono gestiti da un buddy allocator binario: ogni blocco libero di 2^k frame è allineato a 2^k
+ *	     (rispetto all'indice nella coremap) e il suo primo frame è inserito nella lista doppia (next_free/prev_free)
+ *	     di ordine k. Nel primo frame di un blocco libero npages vale 2^k, negli altri frame del blocco vale 0.
+ *	     frame_alloc preleva dalla lista di ordine 0 (O(1)), frame_kalloc e frame_kfree dividono e fondono blocchi
+ *	     in O(log n).
+ *
  */
 
 typedef enum{
 	FREE, 		// frame libero
 	FIXED,		// frame di kernel, non può essere selezionato come vittima
 	LOADING,	// frame allocato, in fase di caricamento da file elf o swapfile. Non può essere selezionato come vittima.
-	CLEAN		// frame allocato, può essere selezionato come vittima
+	CLEAN,		// frame allocato, identico alla sua copia nell'elf (o azzerato) o nel suo slot dello swapfile (swap_slot):
+			// se scelto come vittima viene scartato o torna al suo slot senza essere scritto
+	DIRTY		// frame allocato, modificato o letto dal pool compresso: se scelto come vittima va scritto nello swapfile
 }frame_state;
 
 typedef struct{
@@ -65,26 +125,93 @@ typedef struct{
         vaddr_t virt_addr;
         frame_state state;
         int npages;
-        unsigned int timestamp;
+        unsigned int timestamp;	// istante di caricamento: l'ordine FIFO non cambia mai finché il frame è in memoria
+        unsigned int ref_time;	// ultimo riferimento osservato da WSClock, inizialmente uguale a timestamp
+        int next_free;		// indice del frame successivo nella lista dei frame liberi (-1 se ultimo)
+        int prev_free;		// indice del frame precedente nella lista dei frame liberi (-1 se primo)
+        unsigned char ref;	// bit di riferimento software, usato dalle politiche di rimpiazzamento (vedi cm_policy.h)
+        unsigned char list;	// lista della politica CAR a cui appartiene il frame (0 se nessuna)
+        int as_next;		// frame successivo nella lista dei frame in memoria di as (-1 se ultimo)
+        int as_prev;		// frame precedente nella lista dei frame in memoria di as (-1 se primo)
+        int swap_slot;		// swap cache: slot dello swapfile con una copia del frame CLEAN, -1 se nessuno
+#if OPT_IPT
+        struct addrspace* ipt_as;	// chiave nella page table invertita: resta valida durante lo swap out, finché non
+        vaddr_t ipt_vaddr;		// viene chiamata cm_unmap, anche se as e virt_addr sono già stati azzerati da cm_evict
+        int ipt_next;		// frame successivo nella catena hash (-1 se ultimo)
+#endif
 }cm_entry;
 
+extern cm_entry* coremap;
+
+/*
+ * Magazine per-CPU: piccola pila di frame liberi usata da frame_alloc, frame_kalloc(1) e frame_kfree di una pagina.
+ * E' protetta da un proprio spinlock, acquisito quasi sempre solo dalla CPU proprietaria, quindi non richiede cm_lock;
+ * viene ricaricata e svuotata a blocchi di CM_MAG_BATCH frame. Quando il buddy allocator non ha più frame, le magazine
+ * di tutte le CPU vengono svuotate (mag_drain). I frame in una magazine hanno stato FREE ma non sono nelle liste del
+ * buddy; sono comunque contati come liberi dal pageout daemon.
+ */
+struct cm_magazine{
+	int frames[CM_MAG_SIZE];
+	unsigned int count;
+	struct spinlock lock;	// ordine: prima lock della magazine, poi cm_lock
+};
+
 /*
  * Functions in coremap.c:
  *
  *    cm_bootstrap	 - Bootstrap della coremap. La coremap viene allocata e i frame disponibili vengono contrassegnati come FREE.
  *    cm_bootstrap_4test - Bootstrap di test della coremap. Serve a testare l'uso dello swapfile in caso di memoria fisica piena. Il numero di 
  *			   frame minimo per permettere a palin di funzionare è 17. 
- *    cm_print		 - Stampa le prime 50 entry della coremap.
+ *    cm_print		 - Stampa le statistiche di frammentazione del buddy allocator e le prime 50 entry della coremap.
  *    is_bootstrapped	 - Per sapere se la coremap è stata inizializzata.
- *    frame_kalloc	 - Allocazione di frame consecutivi per il kernel. I frame allocati hanno stato FIXED. Chiamata da alloc_kpages.
- *    frame_alloc	 - Allocazione di un frame per un processo user. I frame allocati possono avere stato LOADING o CLEAN. Per paginazione on
- *			  demand viene chiamata da vm_fault.
- *    frame_kfree	 - Deallocazione di frame di kernel. Chimata da free_kpages.
+ *    frame_kalloc	 - Allocazione di frame consecutivi per il kernel tramite buddy allocator. I frame allocati hanno stato FIXED.
+ *			   I frame oltre nframes del blocco 2^k vengono restituiti subito. Chiamata da alloc_kpages.
+ *    frame_alloc	 - Allocazione di un frame per un processo user. I frame allocati possono avere stato LOADING, CLEAN o DIRTY. Per paginazione on
+ *			  demand viene chiamata da vm_fault. Il frame viene preso dalla magazine della CPU corrente. Se zero vale 1 il frame
+ *			  restituito è azzerato: viene preso dal pool dei frame azzerati o, se il pool è vuoto, azzerato subito.
+ *    frame_kfree	 - Deallocazione di frame di kernel, con fusione dei blocchi buddy. Chimata da free_kpages.
+ *    frame_free	 - Restituisce al buddy allocator un frame ottenuto da cm_evict. Usata dal pageout daemon.
  *    cm_asfree 	 - Cancellazione dalla coremap di tutti i frame relativi a un address space. Chiamata da as_destroy.
- *    cm_evict		 - Ricerca una vittima tra i frame allocati al processo. Usa politica FIFO.
+ *			   Scorre solo la lista dei frame dell'as (as->frames), non tutta la coremap.
+ *    cm_evict		 - Ricerca una vittima con la politica di rimpiazzamento attiva (vedi cm_policy.h), tra i frame del processo
+ *			   o di tutti i processi a seconda di repl_mode. Restituisce anche il proprietario della vittima, se è DIRTY
+ *			   e, se è CLEAN, lo slot dello swapfile che ne contiene ancora una copia (-1 se nessuno).
+ *			   Con as NULL (pageout daemon) la vittima può essere di qualsiasi processo. Per un page fault, se tutti i frame
+ *			   sono protetti dalla politica locale o dalle riserve, la vittima viene scelta tra tutti i frame utente.
+ *			   Se non c'è nessuna vittima owner vale NULL.
+ *    cm_evict_done	 - Da chiamare dopo aver aggiornato la pt del proprietario della vittima.
+ *    cm_check_owner	 - Controlla che un frame sia ancora associato a una pagina (non è stato scelto come vittima).
+ *    cm_set_dirty	 - Segna come DIRTY un frame CLEAN alla prima scrittura e aggiunge PTE_DIRTY alla sua entry pte.
+ *			   Restituisce 0 se il frame è stato scelto come vittima.
+ *			   In slot restituisce lo slot della swap cache, ora non più valido, che il chiamante deve liberare (-1 se nessuno).
+ *    cm_set_slot	 - Associa a un frame LOADING appena letto dallo swapfile il suo slot (swap cache), prima di segnarlo CLEAN.
+ *    cm_reclaim_slot	 - Libera lo slot della swap cache di un frame CLEAN, che diventa DIRTY. Restituisce 0 se non ce ne sono.
+ *    cm_set_repl_mode	 - Imposta la politica di rimpiazzamento (CM_REPL_LOCAL o CM_REPL_GLOBAL).
+ *    cm_get_repl_mode	 - Restituisce la politica di rimpiazzamento.
+ *    cm_set_policy	 - Seleziona per nome la politica con cui vengono scelte le vittime. Restituisce ENOENT o ENOMEM in caso di errore.
+ *    cm_policy_name	 - Restituisce il nome della politica attiva.
+ *    cm_policy_stat	 - Incrementa un contatore REPL_* nel totale di vm_stats e nella politica attiva.
+ *    cm_touch		 - Segna un frame come riferito (TLB reload di una pagina in memoria).
+ *    cm_clear_ref	 - Azzera il bit di riferimento di un frame senza presupporre che sia nella coremap. Chiamata dallo
+ *			   sweep dopo aver invalidato la entry in tlb.
+ *    cm_nframes	 - Numero di entry della coremap.
+ *    cm_now		 - Tempo virtuale della coremap: il contatore usato per i timestamp.
+ *    cm_is_candidate	 - Controlla se il frame pos può essere scelto come vittima per un page fault di as. Da chiamare con cm_lock acquisito.
  *    cm_update_vaddr	 - Da usare in seguito a cm_evict. Aggiorna il vaddr associato alla vittima trovata.
- *    cm_check_state	 - Controlla stato di un frame.
- *    cm_update_state	 - Aggiorna lo stato di un frame.
+ *    cm_check_state	 - Controlla stato di un frame. Non acquisisce cm_lock.
+ *    cm_update_state	 - Aggiorna lo stato di un frame. Non acquisisce cm_lock.
+ *    cm_print_stats	 - Stampa frammentazione, frame nelle magazine per-CPU, contatori di contesa di cm_lock e
+ *			   contatori di ciascuna politica di rimpiazzamento.
+ *    cm_pageout_bootstrap - Crea il wait channel del pageout daemon. Da chiamare quando è possibile allocare memoria.
+ *    cm_pageout_wait	 - Blocca il pageout daemon finché i frame liberi non scendono sotto CM_FREE_LOW.
+ *    cm_pageout_needed	 - Restituisce 1 se i frame liberi sono sotto CM_FREE_HIGH.
+ *    cm_zero_wait	 - Blocca il thread pagezero finché il pool dei frame azzerati non scende sotto la metà.
+ *    cm_zero_take	 - Preleva un frame libero da azzerare per il pool. Restituisce 0 se il pool è pieno o la memoria scarseggia.
+ *    cm_zero_add	 - Aggiunge al pool un frame ottenuto da cm_zero_take e azzerato.
+ *    cm_zero_pool_size	 - Numero di frame nel pool dei frame azzerati.
+ *    cm_lookup		 - Solo con OPT_IPT. Cerca nella page table invertita il frame della pagina vaddr di as; restituisce 0 se la pagina
+ *			   non è in memoria. In dirty restituisce 1 se il frame è DIRTY.
+ *    cm_unmap		 - Solo con OPT_IPT. Toglie dalla page table invertita un frame ottenuto da cm_evict, al posto di pt_update.
  *    cm_shutdown	 - Dealloca la coremap. Chiamata da vm_shutdown.
  */
 
@@ -93,12 +220,40 @@ void cm_bootstrap_4test(void); // per testare lo swapping
 void cm_print(const char* msg);
 int is_bootstrapped(void);
 paddr_t frame_kalloc(unsigned int nframes);
-paddr_t frame_alloc(vaddr_t vaddr, struct addrspace* as);
+paddr_t frame_alloc(vaddr_t vaddr, struct addrspace* as, int zero);
 int frame_kfree(vaddr_t vaddr);
+void frame_free(paddr_t paddr);
 void cm_asfree( struct addrspace* as);
-vaddr_t cm_evict(struct addrspace* as, paddr_t* paddr, int* pos);
+vaddr_t cm_evict(struct addrspace* as, struct addrspace** owner, paddr_t* paddr, int* pos, int* dirty, int* slot);
+void cm_evict_done(struct addrspace* owner);
+int cm_check_owner(paddr_t paddr, struct addrspace* as, vaddr_t vaddr);
+int cm_set_dirty(paddr_t paddr, struct addrspace* as, vaddr_t vaddr, pt_entry* pte, int* slot);
+void cm_set_slot(paddr_t paddr, int slot);
+int cm_reclaim_slot(void);
+void cm_set_repl_mode(int mode);
+int cm_get_repl_mode(void);
+int cm_set_policy(const char* name);
+const char* cm_policy_name(void);
+void cm_policy_stat(unsigned int pos);
+void cm_touch(paddr_t paddr);
+void cm_clear_ref(paddr_t paddr);
+unsigned int cm_nframes(void);
+unsigned int cm_now(void);
+int cm_is_candidate(unsigned int pos, struct addrspace* as);
 int cm_check_state(paddr_t paddr, frame_state state);
 void cm_update_vaddr(struct addrspace* as, int pos, vaddr_t vaddr);
 void cm_update_state(paddr_t paddr, frame_state state);
+void cm_print_stats(void);
+void cm_pageout_bootstrap(void);
+void cm_pageout_wait(void);
+int cm_pageout_needed(void);
+void cm_zero_wait(void);
+paddr_t cm_zero_take(void);
+void cm_zero_add(paddr_t paddr);
+unsigned int cm_zero_pool_size(void);
+#if OPT_IPT
+paddr_t cm_lookup(struct addrspace* as, vaddr_t vaddr, int* dirty);
+void cm_unmap(paddr_t paddr);
+#endif
 void cm_shutdown(void);
 #endif /* _COREMAP_H_ */
@@ -82,10 +82,21 @@ struct cpu {
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
 	 * and vaddr pair, or a paddr, or something else.
+	 *
+	 * If more than TLBSHOOTDOWN_MAX requests pile up, c_numshootdown
+	 * is set to TLBSHOOTDOWN_ALL and the whole TLB gets flushed.
+	 *
+	 * Every request gets a ticket from c_shootdown_seq. After
+	 * handling the queue the CPU sets c_shootdown_done to the last
+	 * ticket handled and wakes up c_shootdown_wchan, on which
+	 * ipi_tlbshootdown_broadcast waits for the acknowledgements.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	unsigned c_shootdown_seq;
+	unsigned c_shootdown_done;
+	struct wchan *c_shootdown_wchan;
 	struct spinlock c_ipi_lock;
 };
 
@@ -150,11 +161,19 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * It returns the ticket of the request (see struct cpu).
+ * ipi_tlbshootdown_broadcast performs the shootdown on the current
+ * CPU, sends it to all the others, and waits until all of them have
+ * handled it. It may sleep: it must not be called with spinlocks held or
+ * from an interrupt handler.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
  */
 
+/* Value of c_numshootdown when the queue overflowed */
+#define TLBSHOOTDOWN_ALL	(TLBSHOOTDOWN_MAX + 1)
+
 /* IPI types */
 #define IPI_PANIC		0	/* System has called panic() */
 #define IPI_OFFLINE		1	/* CPU is requested to go offline */
@@ -163,7 +182,8 @@ void cpu_halt(void);
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
-void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping);
 
 void interprocessor_interrupt(void);
 
@@ -32,31 +32,86 @@
 
 #include <types.h>
 #include <lib.h>
+#include <vm.h>
+#include <mips/tlb.h>
+#include <platform/maxcpus.h>
 
 /*
- * Page table structure
+ * Page table a due livelli, come sui MIPS: una directory di PT_DIR_ENTRIES puntatori a tabelle foglia di una pagina.
+ * L'indice nella directory sono i 10 bit alti dell'indirizzo (blocchi da 4MB di kuseg), l'indice nella foglia i 10 bit successivi.
+ * Lookup, aggiornamento e deallocazione di una pagina costano O(1), indipendentemente dal numero di pagine del processo.
+ *
+ * Ogni entry è una parola da 32 bit con lo stesso formato di EntryLo: i 20 bit alti sono il numero del frame, PTE_VALID
+ * e PTE_DIRTY coincidono con TLBLO_VALID e TLBLO_DIRTY, così la entry della tlb si ottiene con una sola maschera.
+ * I bit bassi, ignorati dalla tlb, tengono lo stato software della pagina.
  */
 
+typedef uint32_t pt_entry;
+
+#define PTE_FRAME	0xfffff000		// frame fisico della pagina se PTE_VALID, slot nello swapfile se PTE_SWAPPED
+#define PTE_DIRTY	TLBLO_DIRTY		// scrittura permessa in tlb: pagina modificata in un segmento scrivibile
+#define PTE_VALID	TLBLO_VALID		// pagina in memoria
+#define PTE_SWAPPED	0x00000100		// pagina nello swapfile
+#define PTE_WRITE	0x00000080		// permesso di scrittura del segmento
+#define PTE_EVICTING	0x00000040		// pagina scelta come vittima, swap out in corso: il frame resta in PTE_FRAME
+
+#define PTE_TLBLO	(PTE_FRAME | PTE_DIRTY | PTE_VALID)	// bit copiati in EntryLo
+
+#define PTE_PADDR(pte)		((pte) & PTE_FRAME)
+#define PTE_IN_MEM(pte)		(((pte) & PTE_VALID) != 0)
+#define PTE_IN_SWAP(pte)	(((pte) & PTE_SWAPPED) != 0)
+#define PTE_IN_EVICTION(pte)	(((pte) & PTE_EVICTING) != 0)
+#define PTE_SLOT(pte)		((int)((pte) >> 12))
+/* entry di una pagina scritta nello slot dello swapfile: swap_in legge direttamente lo slot, senza cercarlo */
+#define PTE_SWAP(pte, slot)	(((pte) & PTE_WRITE) | ((pt_entry)(slot) << 12) | PTE_SWAPPED)
+/* entry di una pagina caricata nel frame paddr; il permesso di scrittura viene mantenuto, PTE_DIRTY solo se scrivibile */
+#define PTE_MAP(pte, paddr, dirty) \
+	(((pte) & PTE_WRITE) | (paddr) | PTE_VALID | (((dirty) && ((pte) & PTE_WRITE)) ? PTE_DIRTY : 0))
+
+#define PT_LEAF_ENTRIES	1024			// PAGE_SIZE/sizeof(pt_entry): una foglia occupa esattamente una pagina
+#define PT_DIR_SHIFT	22			// 12 bit di offset + 10 bit di indice nella foglia
+#define PT_DIR_ENTRIES	512			// kuseg (2GB) / 4MB coperti da una foglia
+
+#define PT_DIR_INDEX(vaddr)	((vaddr) >> PT_DIR_SHIFT)
+#define PT_LEAF_INDEX(vaddr)	(((vaddr) >> 12) & (PT_LEAF_ENTRIES-1))
+
 typedef struct{
-	vaddr_t page;
-	paddr_t frame;
-	int in_mem;
-	int in_swap;
-	struct pt_entry* next;
-}pt_entry;
+	pt_entry* dir[PT_DIR_ENTRIES];		// NULL se nessuna pagina del blocco da 4MB è stata ancora usata
+}pagetable;
+
+/*
+ * Directory dell'as attivo su ciascuna CPU (NULL se nessuno), usata dal gestore del TLB miss in assembly
+ * (mips_utlb_handler in exception-mips1.S). Il gestore scorre directory e foglia e, se la entry ha PTE_VALID, la scrive
+ * in tlb con tlbwr senza passare da vm_fault; altrimenti prosegue con la gestione generale dell'eccezione.
+ * Il gestore conosce il formato della pt: PT_DIR_SHIFT, PT_LEAF_INDEX e PTE_VALID vanno modificati anche lì.
+ */
+extern pagetable* utlb_pgdir[MAXCPUS];
 
 
 /*
  * Functions in pt.c:
  *
- *    pt_create		- Alloca una pagina.
- *    pt_free		- Dealloca una pagina.
- *    pt_update		- Aggiorna lo stato di una pagina a in_swap=1. Usata dopo swap_in.
- *    pt_print_state	- Stampa la page table.
+ *    pt_create		- Alloca la directory vuota di un as.
+ *    pt_alloc_range	- Alloca le foglie che coprono npages pagine a partire da vaddr e vi registra il permesso di scrittura
+ *			  del segmento. Le entry partono senza frame (pagina non ancora caricata).
+ *    pt_lookup		- Restituisce la entry di vaddr, NULL se la foglia non esiste.
+ *    pt_get		- Restituisce la entry di vaddr, allocando la foglia se non esiste ancora (paginazione on demand: le foglie
+ *			  vengono create al primo fault di una pagina del blocco da 4MB). NULL se manca la memoria.
+ *    pt_free		- Dealloca le foglie e la directory.
+ *    pt_evicting	- Toglie PTE_VALID alla entry di una vittima e la segna PTE_EVICTING, prima dello shootdown: da lì il
+ *			  refill in assembly non può più reinserire la pagina in tlb e vm_fault attende la fine dello swap out.
+ *    pt_update		- Segna una pagina come non più in memoria, con lo slot dello swapfile in cui è stata scritta o -1 se è stata
+ *			  scartata. Usata dopo swap_out
+ *			  o dopo aver scartato una pagina non modificata.
+ *    pt_print_state	- Stampa le pagine presenti nella page table.
  */
 
-pt_entry* pt_create(vaddr_t vaddr);
-void pt_free(pt_entry* pt);
-void pt_update(pt_entry* pt, vaddr_t vaddr);
-void pt_print_state(pt_entry* pte);
+pagetable* pt_create(void);
+int pt_alloc_range(pagetable* pt, vaddr_t vaddr, int npages, int write);
+pt_entry* pt_lookup(pagetable* pt, vaddr_t vaddr);
+pt_entry* pt_get(pagetable* pt, vaddr_t vaddr);
+void pt_free(pagetable* pt);
+void pt_evicting(pagetable* pt, vaddr_t vaddr);
+void pt_update(pagetable* pt, vaddr_t vaddr, int slot);
+void pt_print_state(pagetable* pt);
 #endif /* _PT_H_ */
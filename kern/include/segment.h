@@ -47,18 +47,38 @@ typedef struct{
 	vaddr_t first_addr; 		// primo indirizzo virtuale del segmento (allineato alla pagina)
 	int npages;			// numero di pagine del segmento
 	size_t size;			// dimensione esatta del segmento, letta dall'elf
+	size_t filesz;			// byte del segmento presenti nell'elf; i successivi fino a size (bss) partono azzerati
 	off_t offset;			// offset del segmento nell'elf. Va usato per accesso diretto al segmento nel file elf e per capire se il segmento è allineato alle pagine
 	permissions* permission;	// permessi del segmento
-	pt_entry* first_pt_entry;	// punta alla prima pagina di questo segmento. Serve a ottimizzare la ricerca nella page table
-	struct segment_entry* next;
 }segment_entry;
 
+/*
+ * Segmenti di un address space: vettore ordinato per first_addr (i segmenti non si sovrappongono), in cui il segmento
+ * di un indirizzo si cerca con una ricerca binaria. last è l'ultimo segmento trovato: i fault consecutivi cadono quasi
+ * sempre nello stesso segmento e vengono risolti senza ricerca.
+ */
+#define SGM_TABLE_INIT 4		// capacità iniziale del vettore: codice, dati, stack e un segmento di riserva
+
+typedef struct{
+	segment_entry** seg;		// segmenti ordinati per first_addr
+	int count;			// segmenti presenti
+	int size;			// capacità del vettore, raddoppiata quando è pieno
+	segment_entry* last;		// ultimo segmento trovato da sgm_lookup (NULL se nessuno)
+}segment_table;
+
 /*
  * Functions in segment.c:
  *
  *    sgm_create	- Alloca un segmento.
- *    sgm_free		- Dealloca un segmento.
+ *    sgm_init		- Inizializza un vettore di segmenti vuoto.
+ *    sgm_insert	- Inserisce un segmento nel vettore mantenendo l'ordine. Restituisce ENOMEM se il vettore non può crescere.
+ *    sgm_lookup	- Restituisce il segmento che contiene vaddr, NULL se nessuno. Prova prima l'ultimo segmento trovato, poi
+ *			  fa una ricerca binaria.
+ *    sgm_free		- Dealloca tutti i segmenti e il vettore.
  */
-segment_entry* sgm_create(vaddr_t vaddr,off_t offset, int sz,size_t segsz,int r,int w ,int x,segment_entry* next);	
-void sgm_free(segment_entry* sge);
+segment_entry* sgm_create(vaddr_t vaddr,off_t offset, int sz,size_t segsz,size_t filesz,int r,int w ,int x);	
+void sgm_init(segment_table* st);
+int sgm_insert(segment_table* st, segment_entry* sgm);
+segment_entry* sgm_lookup(segment_table* st, vaddr_t vaddr);
+void sgm_free(segment_table* st);
 #endif /* _SEGMENT_H_ */
@@ -37,8 +37,15 @@
 #include <addrspace.h>
 #include <kern/fcntl.h>
 #include <uio.h>
+#include "opt-ipt.h"
+#include "opt-zswap.h"
 
 #define SWAP_SIZE 9*1024*1024 / 4096
+#define SWAP_WORDS ((SWAP_SIZE+31)/32)	// parole della bitmap degli slot occupati
+#define SWAP_DEVNAME_LEN 16	// lunghezza massima del nome del disco di swap (es. "lhd1")
+#define SWAP_CLUSTER 8		// pagine al più scritte o lette con una sola richiesta al disco
+#define SWAP_READAHEAD 4	// pagine al più lette in anticipo ad ogni swap in (<= SWAP_CLUSTER-1)
+#define SWAP_HASH_SIZE 1024	// teste della tabella hash (as, vaddr) -> slot, usata con OPT_IPT per sapere se una pagina è nello swapfile
 
 /*
  * Swapfile structure
@@ -47,22 +54,71 @@
 struct swap_entry{
 	struct addrspace* as;
 	vaddr_t vaddr;
+	int next;		// slot successivo nella lista degli slot di as (-1 se ultimo)
+	int prev;		// slot precedente nella lista degli slot di as (-1 se primo)
+#if OPT_IPT
+	int hash_next;		// slot successivo nella catena hash (-1 se ultimo)
+#endif
+#if OPT_ZSWAP
+	void* zdata;		// pagina compressa nel pool (zswap.h), NULL se la pagina è solo nello swapfile
+	unsigned int zlen;	// byte di zdata
+	int znext;		// slot successivo nel pool, dal più vecchio al più recente (-1 se ultimo)
+	int zprev;		// slot precedente nel pool (-1 se primo)
+	char zwb;		// la pagina uscita dal pool è in scrittura nello swapfile
+	char zfree;		// lo slot è stato liberato durante la scrittura: lo libera chi scrive
+#endif
+};
+
+/*
+ * Vittima da scrivere nello swapfile (swap_out riempie slot) o, se CLEAN, ancora nel suo slot della swap cache
+ */
+
+struct swap_page{
+	struct addrspace* as;
+	vaddr_t vaddr;
+	paddr_t paddr;
+	int slot;
 };
 
 /*
  * Functions in swap.c:
  * swapspace_bootstrap	- Alloca il vettore swapspace parallelo allo swapfile, apre lo swapfile.
- * swap_in		- Scrive un frame nello swapfile.
- * swap_out		- Legge un frame dallo swapfile.
+ * swap_in		- Legge dagli n slot consecutivi a partire da slot le pagine vaddrs di as, copiandole nei frame paddrs, con
+ *			  una sola richiesta. Lo slot viene dalla entry della page table (PTE_SLOT) o, con OPT_IPT, da
+ *			  swap_lookup; gli altri n-1 da swap_neighbours. Gli slot restano assegnati alle pagine (swap cache):
+ *			  cached[i] vale 1 se lo slot contiene ancora una copia della pagina i, 0 se è stato liberato.
+ * swap_drop		- Libera lo slot della swap cache di una pagina che è stata modificata.
+ * swap_out		- Scrive nello swapfile gli n frame descritti da pages. Ogni gruppo di SWAP_CLUSTER pagine riceve slot
+ *			  consecutivi, cercati nella bitmap a partire dall'ultima parola usata (next fit), e viene scritto con
+ *			  una sola richiesta. Restituisce in pages[i].slot lo slot, da registrare nella page table.
+ * swap_neighbours	- Restituisce in vaddrs le pagine di as negli slot successivi a slot (al più max, fermandosi al primo slot
+ *			  di un altro as o libero): le pagine scritte insieme, candidate alla lettura anticipata.
  * print_swap_state	- Stampa le entry piene del vettore swapspace.
- * swap_asfree		- Elimina dal vettore swapspace tutte le entry relative all'address space. Chiamata in as_destroy.
- * swapspace_shutdown	- Dealloca il vettore swapspace e chiude lo swapfile. Chiamamta da vm_shutdown.
+ * swap_asfree		- Elimina dal vettore swapspace tutte le entry relative all'address space, scorrendo solo la lista degli
+ *			  slot dell'as (as->swap_slots). Chiamata in as_destroy.
+ * swap_lookup		- Solo con OPT_IPT. Restituisce lo slot della pagina vaddr di as, -1 se non è nello swapfile: senza page table
+ *			  per processo è l'unico modo di distinguere una pagina nello swapfile da una mai caricata.
+ * swap_setdevice	- Sposta lo swap dallo swapfile (emu0:swapfile) al disco raw devname (es. lhd1), segnato come disco di
+ *			  swap con vfs_swapon, usando al più SWAP_SIZE pagine. Le pagine vengono lette e scritte direttamente
+ *			  dal driver del disco. Possibile solo finché lo swap è vuoto (EBUSY), quindi va scelto all'avvio,
+ *			  con il comando swapon del menu sulla riga di comando del kernel.
+ * swapspace_shutdown	- Dealloca il vettore swapspace e chiude lo swapfile o rilascia il disco. Chiamamta da vm_shutdown.
+ *
+ * Con OPT_ZSWAP swap_out prova prima a comprimere ogni pagina nel pool compresso (zswap.h); swap_in legge dallo
+ * swapfile solo le pagine che non sono nel pool. Quando il pool supera ZSWAP_POOL_BYTES, swap_out scrive nello
+ * swapfile le pagine entrate nel pool da più tempo, ognuna nel proprio slot.
  */
  
 void swapspace_bootstrap(void);
-void swap_in(struct addrspace* as, vaddr_t vaddr);
-void swap_out(struct addrspace* as, vaddr_t vaddr);
+void swap_in(struct addrspace* as, int slot, vaddr_t* vaddrs, paddr_t* paddrs, int n, int* cached);
+void swap_drop(struct addrspace* as, int slot);
+void swap_out(struct swap_page* pages, int n);
+int swap_neighbours(struct addrspace* as, int slot, vaddr_t* vaddrs, int max);
 void print_swap_state(const char* msg);
 void swap_asfree(struct addrspace* as);
+#if OPT_IPT
+int swap_lookup(struct addrspace* as, vaddr_t vaddr);
+#endif
+int swap_setdevice(const char* devname);
 void swapspace_shutdown(void);
 #endif /* _SWAP_H_ */
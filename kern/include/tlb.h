@@ -35,16 +35,83 @@
 #include <lib.h>
 #include <spl.h>
 #include "vm_stats.h"
+#include "pt.h"
+#include <platform/maxcpus.h>
+
+/*
+ * ASID: ogni as riceve su ciascuna CPU un identificatore da 1 a NUM_ASID-1 (0 resta agli as inattivi), scritto nel
+ * campo PID di EntryHi da as_activate. Le entry della tlb di un processo sopravvivono così ai cambi di contesto.
+ * Gli ASID di una CPU vengono assegnati in sequenza all'interno di una generazione: quando sono esauriti la tlb
+ * viene svuotata e inizia una nuova generazione, in cui ogni as riceve un nuovo ASID alla prossima attivazione.
+ */
+struct tlb_asid{
+	unsigned int gen;		// generazione in cui è stato assegnato asid, 0 se mai assegnato
+	unsigned int asid;
+};
+
+/*
+ * TLB software per-CPU: cache a indirizzamento diretto di STLB_SIZE traduzioni (id dell'as, pagina) -> entry della pt,
+ * consultata da vm_fault prima di qualsiasi struttura della memoria virtuale. L'id è unico per ogni as creato e non
+ * viene mai riusato, quindi le entry di un as distrutto non vanno cancellate: non verranno più trovate.
+ * Le entry vengono invalidate insieme alla tlb, dagli shootdown delle pagine scelte come vittime.
+ */
+#define STLB_SIZE 64
+
+struct stlb_entry{
+	unsigned int id;		// id dell'as, 0 se la entry è vuota
+	vaddr_t vaddr;			// pagina
+	pt_entry pte;			// entry della pt al momento dell'inserimento (frame, valid e dirty)
+};
+
+/*
+ * Scelta della entry da sostituire quando la tlb è piena. Ogni CPU tiene una bitmap degli slot occupati, così uno slot
+ * libero si trova leggendo solo gli slot che la bitmap indica liberi (il refill in assembly li occupa senza aggiornarla),
+ * e una lancetta propria.
+ * TLB_REPL_RR: round-robin. TLB_REPL_RANDOM: slot scelto dal processore (tlbwr), come nel refill in assembly.
+ * TLB_REPL_NRU: come rr, ma salta una volta gli slot scritti o resi scrivibili dopo l'ultimo passaggio della lancetta,
+ * così le traduzioni appena usate (stack, codice in esecuzione) non vengono tolte solo per il loro ordine.
+ */
+#define TLB_REPL_RR 0
+#define TLB_REPL_RANDOM 1
+#define TLB_REPL_NRU 2
+#define TLB_REPL_DEFAULT TLB_REPL_NRU
 
 /*
  * Functions in tlb.c:
  * tlb_print	- Stampa il contenuto della tlb.
- * tlbR		- Rimpiazza il vaddr passato come primo parametro con quello passato come secondo. 
- * tlbW		- Scrive una entry in tlb. Se la tlb è piena si sceglie una vittima con modalità round-robin.
+ * tlb_activate	- Rende corrente sulla CPU l'as con ASID ids[curcpu], assegnandone uno nuovo se non appartiene alla generazione
+ *		  corrente. Restituisce 1 se gli ASID erano esauriti e la tlb è stata svuotata.
+ * tlb_invalidate	- Invalida le entry della tlb relative a vaddr, di qualsiasi ASID.
+ * tlb_invalidate_all	- Invalida tutta la tlb.
+ * tlb_set_dirty	- Abilita la scrittura sulla entry della tlb relativa a vaddr per l'as corrente, se presente.
+ * tlb_sweep	- Toglie TLBLO_VALID alle entry dell'ASID corrente azzerando il bit di riferimento dei frame. Restituisce il
+ *		  numero di entry invalidate.
+ * stlb_newid	- Restituisce un nuovo id per un as (mai 0).
+ * stlb_lookup	- Cerca la traduzione di vaddr per l'as id nella tlb software della CPU corrente. Restituisce 1 e la entry della pt
+ *		  in pte se la trova.
+ * stlb_insert	- Inserisce una traduzione nella tlb software della CPU corrente. Va chiamata con interrupt disabilitati, nella stessa
+ *		  sezione in cui si controlla che il frame appartenga ancora alla pagina: uno shootdown arrivato dopo la trova.
+ * stlb_invalidate	- Invalida, se presente, la traduzione di vaddr per l'as id nella tlb software della CPU corrente.
+ * stlb_invalidate_all	- Invalida tutta la tlb software della CPU corrente.
+ * tlbW		- Scrive in tlb la entry della page table di faultaddress (frame, valid e dirty) con l'ASID corrente. Se la tlb è piena si sceglie
+ *		  una vittima con la politica selezionata.
+ * tlb_set_repl	- Seleziona la politica di sostituzione delle entry (TLB_REPL_*).
+ * tlb_get_repl	- Restituisce la politica di sostituzione delle entry.
 */
 
 void tlb_print(void);
-void tlbR(vaddr_t victim,vaddr_t faultaddress, paddr_t paddr); // TLB replace entry
-void tlbW(vaddr_t faultaddress, paddr_t paddr, int write);
+int tlb_activate(struct tlb_asid* ids);
+void tlb_invalidate(vaddr_t vaddr);
+void tlb_invalidate_all(void);
+void tlb_set_dirty(vaddr_t vaddr);
+unsigned int tlb_sweep(void);
+unsigned int stlb_newid(void);
+int stlb_lookup(unsigned int id, vaddr_t vaddr, pt_entry* pte);
+void stlb_insert(unsigned int id, vaddr_t vaddr, pt_entry pte);
+void stlb_invalidate(unsigned int id, vaddr_t vaddr);
+void stlb_invalidate_all(void);
+void tlbW(vaddr_t faultaddress, pt_entry pte);
+void tlb_set_repl(int repl);
+int tlb_get_repl(void);
 
 #endif /* _TLB_H_ */
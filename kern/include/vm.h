@@ -60,6 +60,18 @@ void free_kpages(vaddr_t addr);
 
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
+void vm_tlbshootdown_all(void);
+
+/* Start the pageout daemon, once threads and the swapfile are available */
+void vm_pageout_bootstrap(void);
+
+/* Start the thread that fills the pool of pre-zeroed frames */
+void vm_pagezero_bootstrap(void);
+
+/* Soft reference bit sweep, called by hardclock on each processor */
+void vm_refsweep(void);
+void vm_set_refsweep(unsigned ticks);
+unsigned vm_get_refsweep(void);
 
 
 //erano static e le abbiamo messe nel file header perchè non si vedevano da addrspace.c
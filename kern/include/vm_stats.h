@@ -34,7 +34,7 @@
 /*
  * Define statistics id
  */
-#define TOT_COUNTERS       10
+#define TOT_COUNTERS       34
 
 #define TLB_FAULT           0
 #define TLB_FAULT_FREE      1
@@ -46,6 +46,30 @@
 #define PAGE_FAULT_ELF      7
 #define PAGE_FAULT_SWAP     8
 #define SWAP_FILE_WRITE     9
+#define REPL_HIT           10	// TLB reload di una pagina in memoria
+#define REPL_MISS          11	// pagina portata in memoria (da elf, swapfile o azzerata)
+#define REPL_SECOND_CHANCE 12	// frame risparmiati dalla politica di rimpiazzamento perché riferiti
+#define REPL_GHOST_HIT     13	// pagine ricaricate mentre erano nelle liste fantasma (solo CAR)
+#define REF_SWEEP          14	// sweep del bit di riferimento eseguiti
+#define REF_SWEEP_INVALID  15	// entry della tlb invalidate dagli sweep
+#define PAGE_DIRTY         16	// prime scritture su pagine CLEAN (VM_FAULT_READONLY)
+#define PAGE_DISCARD       17	// vittime CLEAN scartate senza scrittura nello swapfile
+#define PAGEOUT_WAKEUP     18	// risvegli del pageout daemon
+#define PAGEOUT_FREED      19	// frame liberati dal pageout daemon
+#define PAGEOUT_SYNC       20	// eviction sincrone nel page fault (nessun frame libero)
+#define ZERO_POOL_HIT      21	// frame azzerati presi dal pool
+#define ZERO_POOL_MISS     22	// frame azzerati nel page fault perché il pool era vuoto
+#define STLB_HIT           23	// TLB reload risolti dalla tlb software per-CPU
+#define AS_ACTIVATE_SKIP   24	// as_activate dello stesso as già attivo sulla CPU
+#define SWAP_CLUSTER_WRITE 25	// scritture nello swapfile di più pagine con una sola richiesta
+#define SWAP_READAHEAD_PAGE 26	// pagine lette dallo swapfile in anticipo insieme a quella del fault
+#define ZSWAP_STORE        27	// pagine entrate nel pool compresso (OPT_ZSWAP)
+#define ZSWAP_REJECT       28	// pagine incomprimibili scritte direttamente nello swapfile
+#define ZSWAP_HIT          29	// pagine lette dal pool compresso invece che dallo swapfile
+#define ZSWAP_WRITEBACK    30	// pagine uscite dal pool e scritte nello swapfile
+#define ZSWAP_BYTES        31	// byte compressi entrati nel pool
+#define ZSWAP_USEC         32	// microsecondi spesi a comprimere e decomprimere
+#define SWAP_CACHE_HIT     33	// vittime CLEAN tornate al loro slot dello swapfile senza essere riscritte
 
 
 /*
@@ -53,11 +77,13 @@
  *
  *    vmstats_init	- Initialize statistics
  *    vmstats_inc 	- Increment specific counter
+ *    vmstats_add 	- Add n to specific counter
  *    vmstats_print 	- Print statistics
  */
 
 void vmstats_init(void);        
 void vmstats_inc(unsigned int pos);
+void vmstats_add(unsigned int pos, unsigned int n);
 void vmstats_print(void);
 
 #endif /* _VM_STATS_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _ZSWAP_H_
+#define _ZSWAP_H_
+
+#include <types.h>
+#include <lib.h>
+#include <vm.h>
+
+#define ZSWAP_MAX_LEN (PAGE_SIZE/2)	// una pagina entra nel pool solo se compressa occupa al più metà pagina
+#define ZSWAP_POOL_BYTES (64*1024)	// byte compressi nel pool oltre i quali le pagine più vecchie vengono scritte nello swapfile
+#define ZSWAP_HASH_SIZE 1024		// entry della tabella hash del compressore (potenza di 2)
+
+/*
+ * Pool compresso tra l'eviction e lo swapfile (OPT_ZSWAP). Le pagine scritte da swap_out vengono compresse con un
+ * compressore LZ77 (stile LZRW1: offset di 12 bit, lunghezze da 3 a 18 byte) e tenute in memoria allocata con kmalloc;
+ * vanno su disco solo le pagine che non si comprimono abbastanza e quelle che escono dal pool perché è pieno.
+ * Il pool (una pagina compressa per slot) è gestito in swap.c; qui c'è solo la compressione.
+ */
+
+/*
+ * Functions in zswap.c:
+ * zswap_bootstrap	- Alloca la tabella hash e il buffer di uscita del compressore. Chiamata da swapspace_bootstrap.
+ * zswap_compress	- Comprime il frame paddr in un buffer allocato con kmalloc, restituito in data. Restituisce la
+ *			  lunghezza, 0 se la pagina compressa supera ZSWAP_MAX_LEN o manca memoria per il buffer.
+ * zswap_decompress	- Decomprime data (len byte, da zswap_compress) nella pagina all'indirizzo kernel dst.
+ */
+
+void zswap_bootstrap(void);
+unsigned int zswap_compress(paddr_t paddr, void** data);
+void zswap_decompress(const void* data, unsigned int len, void* dst);
+
+#endif /* _ZSWAP_H_ */
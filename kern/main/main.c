@@ -138,11 +138,15 @@ boot(void)
 #endif
 	kprintf_bootstrap();
 	thread_start_cpus();
+#if OPT_COREMAP
+	vm_pagezero_bootstrap();
+#endif
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
 #if OPT_SWAP
 	swapspace_bootstrap();
+	vm_pageout_bootstrap();
 #endif
 	kheap_nextgeneration();
 
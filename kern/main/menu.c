@@ -43,6 +43,14 @@
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-swap.h"
+#if OPT_SWAP
+#include <vm.h>
+#include "coremap.h"
+#include "cm_policy.h"
+#include "tlb.h"
+#include "swap.h"
+#endif
 
 /*
  * In-kernel menu and command dispatcher.
@@ -361,6 +369,134 @@ cmd_bootfs(int nargs, char **args)
 	return vfs_setbootfs(device);
 }
 
+#if OPT_SWAP
+/*
+ * Command for selecting the page replacement scope: victims are taken
+ * from the faulting process only (local) or from every process
+ * (global). With no argument, print the current setting.
+ */
+static
+int
+cmd_vmrepl(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "local")) {
+		cm_set_repl_mode(CM_REPL_LOCAL);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "global")) {
+		cm_set_repl_mode(CM_REPL_GLOBAL);
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: vmrepl [local|global]\n");
+		return EINVAL;
+	}
+
+	kprintf("Page replacement: %s\n",
+		cm_get_repl_mode() == CM_REPL_GLOBAL ? "global" : "local");
+	return 0;
+}
+
+/*
+ * Command for selecting the page replacement policy. It can also be
+ * given on the kernel command line to choose the policy at boot.
+ * With no argument, print the current policy and the available ones.
+ */
+static
+int
+cmd_vmpolicy(int nargs, char **args)
+{
+	int result;
+
+	if (nargs > 2) {
+		kprintf("Usage: vmpolicy [fifo|clock|wsclock|car]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		result = cm_set_policy(args[1]);
+		if (result) {
+			kprintf("vmpolicy: %s: %s\n", args[1], strerror(result));
+			return result;
+		}
+	}
+
+	kprintf("Page replacement policy: %s\nAvailable policies: ", cm_policy_name());
+	cm_policy_list();
+	return 0;
+}
+
+/*
+ * Command for setting the reference bit sweep interval, in hardclock
+ * ticks. 0 disables the sweep. With no argument, print the current
+ * interval.
+ */
+static
+int
+cmd_vmsweep(int nargs, char **args)
+{
+	if (nargs == 2 && atoi(args[1]) >= 0) {
+		vm_set_refsweep(atoi(args[1]));
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: vmsweep [ticks]\n");
+		return EINVAL;
+	}
+
+	kprintf("Reference bit sweep: every %u hardclocks\n",
+		vm_get_refsweep());
+	return 0;
+}
+
+/*
+ * Command for moving swap to a raw disk device (e.g. lhd1). Only
+ * possible while nothing is swapped out, so give it on the kernel
+ * command line to choose the swap device at boot.
+ */
+static
+int
+cmd_swapon(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: swapon device\n");
+		return EINVAL;
+	}
+
+	result = swap_setdevice(args[1]);
+	if (result) {
+		kprintf("swapon: %s: %s\n", args[1], strerror(result));
+	}
+	return result;
+}
+
+/*
+ * Command for selecting how a TLB entry is chosen for replacement
+ * when the TLB is full. With no argument, print the current policy.
+ */
+static
+int
+cmd_vmtlb(int nargs, char **args)
+{
+	static const char *names[] = { "rr", "random", "nru" };
+
+	if (nargs == 2 && !strcmp(args[1], "rr")) {
+		tlb_set_repl(TLB_REPL_RR);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "random")) {
+		tlb_set_repl(TLB_REPL_RANDOM);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "nru")) {
+		tlb_set_repl(TLB_REPL_NRU);
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: vmtlb [rr|random|nru]\n");
+		return EINVAL;
+	}
+
+	kprintf("TLB replacement: %s\n", names[tlb_get_repl()]);
+	return 0;
+}
+#endif
+
 static
 int
 cmd_kheapstats(int nargs, char **args)
@@ -441,6 +577,13 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+#if OPT_SWAP
+	"[vmrepl]  Page replacement scope    ",
+	"[vmpolicy] Page replacement policy  ",
+	"[vmsweep] Reference bit sweep rate  ",
+	"[vmtlb]   TLB entry replacement     ",
+	"[swapon]  Swap on a raw disk        ",
+#endif
 	"[panic]   Intentional panic         ",
 	"[q]       Quit and shut down        ",
 	NULL
@@ -547,6 +690,13 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+#if OPT_SWAP
+	{ "vmrepl",	cmd_vmrepl },
+	{ "vmpolicy",	cmd_vmpolicy },
+	{ "vmsweep",	cmd_vmsweep },
+	{ "vmtlb",	cmd_vmtlb },
+	{ "swapon",	cmd_swapon },
+#endif
 	{ "panic",	cmd_panic },
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
@@ -93,15 +93,7 @@ load_segment(struct addrspace *as, struct vnode *v,
 		filesize = memsize;
 	}
 	
-	pt_entry* p=as->pt;
-	paddr_t frame;
-	while(p !=NULL){
-		if(p->page == vaddr){
-			frame = p->frame;
-			break;
-		}
-		p = (pt_entry*)p->next;
-	}
+	paddr_t frame = PTE_PADDR(*pt_lookup(as->pt, vaddr & PAGE_FRAME));
 	kprintf("\nframe : 0x%lx\n",(unsigned long)frame);
 	DEBUG(DB_EXEC, "ELF: Loading %lu bytes to 0x%lx\n",
 	      (unsigned long) filesize, (unsigned long) vaddr);
@@ -162,16 +154,16 @@ load_segment(struct addrspace *as, struct vnode *v,
 /*
 *	Load_page_from_elf - carica solo la pagina che ha causato il page fault.
 *
-*
+*	La lettura avviene all'indirizzo di kernel kvaddr (KSEG0) del frame: la pagina non è ancora visibile al processo.
 */
 int
-load_page_from_elf(struct addrspace *as, vaddr_t vaddr, off_t offset, size_t memsize, size_t filesize,int is_executable){
+load_page_from_elf(struct addrspace *as, vaddr_t kvaddr, off_t offset, size_t memsize, size_t filesize){
 	     
 	struct iovec iov;
 	struct uio u;
 	int result;
 	struct vnode *v;
-	//(void)is_executable;
+
 	if (filesize > memsize) {
 		kprintf("ELF: warning: segment filesize > segment memsize\n");
 		filesize = memsize;
@@ -179,17 +171,7 @@ load_page_from_elf(struct addrspace *as, vaddr_t vaddr, off_t offset, size_t mem
 	
 	v = as->elf_file;
 	
-	iov.iov_ubase = (userptr_t)vaddr;
-	iov.iov_len = memsize;		 // length of the memory space
-	u.uio_iov = &iov;
-	u.uio_iovcnt = 1;
-	u.uio_resid = filesize;          // amount to read from the file
-	u.uio_offset = offset;
-	u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
-	u.uio_rw = UIO_READ;
-	u.uio_space = as;
-
-	//uio_kinit(&iov, &u, (void*)vaddr, memsize, offset, UIO_READ);
+	uio_kinit(&iov, &u, (void*)kvaddr, filesize, offset, UIO_READ);
 	result = VOP_READ(v, &u);
 	if (result) {
 		return result;
@@ -313,7 +295,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 #else
 		result = as_define_region(as,
 					  ph.p_vaddr, ph.p_offset,
-					  ph.p_memsz,
+					  ph.p_memsz, ph.p_filesz,
 					  ph.p_flags & PF_R,
 					  ph.p_flags & PF_W,
 					  ph.p_flags & PF_X);
@@ -34,6 +34,8 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <vm.h>
+#include "opt-coremap.h"
 
 /*
  * Time handling.
@@ -97,6 +99,9 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+#if OPT_COREMAP
+	vm_refsweep();
+#endif
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -49,6 +49,7 @@
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
+#include <platform/maxcpus.h>
 #include <vnode.h>
 
 
@@ -185,6 +186,12 @@ cpu_create(unsigned hardware_number)
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_seq = 0;
+	c->c_shootdown_done = 0;
+	c->c_shootdown_wchan = wchan_create("tlbshootdown");
+	if (c->c_shootdown_wchan == NULL) {
+		panic("cpu_create: Out of memory\n");
+	}
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -1126,25 +1133,22 @@ ipi_broadcast(int code)
 /*
  * Send a TLB shootdown IPI to the specified CPU.
  */
-void
+unsigned
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	unsigned n;
+	unsigned n, seq;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
+	seq = ++target->c_shootdown_seq;
+
 	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
+	if (n >= TLBSHOOTDOWN_MAX) {
 		/*
-		 * If you have problems with this panic going off,
-		 * consider: (1) increasing the maximum, (2) putting
-		 * logic here to sleep until space appears (may
-		 * interact awkwardly with VM system locking), (3)
-		 * putting logic here to coalesce requests together,
-		 * and/or (4) improving VM system state tracking to
-		 * reduce the number of unnecessary shootdowns.
+		 * Too many requests queued: coalesce them all into
+		 * a flush of the whole TLB.
 		 */
-		panic("ipi_tlbshootdown: Too many shootdowns queued\n");
+		target->c_numshootdown = TLBSHOOTDOWN_ALL;
 	}
 	else {
 		target->c_shootdown[n] = *mapping;
@@ -1155,6 +1159,51 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
+	return seq;
+}
+
+/*
+ * Invalidate the mapping on the current CPU and send a TLB shootdown
+ * IPI to all the others, then wait for each of them to handle it:
+ * until then a CPU may still hold the old translation, so the caller
+ * must not reuse the page. The local invalidation and the choice of
+ * the CPUs to interrupt happen with interrupts off, so a thread
+ * migrated in between cannot leave one CPU out.
+ */
+void
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i, num;
+	unsigned seq[MAXCPUS];
+	struct cpu *c, *self;
+	int spl;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	/* the thread may migrate while it sleeps: remember where it started */
+	spl = splhigh();
+	self = curcpu->c_self;
+	vm_tlbshootdown(mapping);
+	num = cpuarray_num(&allcpus);
+	KASSERT(num <= MAXCPUS);
+	for (i=0; i < num; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != self) {
+			seq[i] = ipi_tlbshootdown(c, mapping);
+		}
+	}
+	splx(spl);
+	for (i=0; i < num; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == self) {
+			continue;
+		}
+		spinlock_acquire(&c->c_ipi_lock);
+		while ((int)(c->c_shootdown_done - seq[i]) < 0) {
+			wchan_sleep(c->c_shootdown_wchan, &c->c_ipi_lock);
+		}
+		spinlock_release(&c->c_ipi_lock);
+	}
 }
 
 /*
@@ -1198,10 +1247,18 @@ interprocessor_interrupt(void)
 		 * need to release the ipi lock while calling
 		 * vm_tlbshootdown.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		if (curcpu->c_numshootdown == TLBSHOOTDOWN_ALL) {
+			vm_tlbshootdown_all();
+		}
+		else {
+			for (i=0; i<curcpu->c_numshootdown; i++) {
+				vm_tlbshootdown(&curcpu->c_shootdown[i]);
+			}
 		}
 		curcpu->c_numshootdown = 0;
+		/* every queued request (even coalesced ones) is done */
+		curcpu->c_shootdown_done = curcpu->c_shootdown_seq;
+		wchan_wakeall(curcpu->c_shootdown_wchan, &curcpu->c_ipi_lock);
 	}
 
 	curcpu->c_ipi_pending = 0;
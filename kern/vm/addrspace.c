@@ -33,10 +33,13 @@
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <current.h>
+#include <cpu.h>
 #include <mips/tlb.h>
 #include <spl.h>
 #include "coremap.h"
 #include "vm_stats.h"
+#include "tlb.h"
 #include <vfs.h>
 #include "swap.h"
 
@@ -51,6 +54,8 @@
 
 
 #if OPT_PT
+static struct addrspace *as_last[MAXCPUS];	// ultimo as attivato su ciascuna CPU, NULL se distrutto
+
 struct addrspace *
 as_create(void)
 {
@@ -61,11 +66,24 @@ as_create(void)
 		return NULL;
 	}
 
-	as->pt = NULL;
-	as->segments = NULL;
+#if !OPT_IPT
+	as->pt = pt_create();
+	if (as->pt == NULL) {
+		kfree(as);
+		return NULL;
+	}
+#endif
+	sgm_init(&as->segments);
 	as->elf_file = NULL;
 	as->heap_start = 0;
 	as->heap_end = 0; 
+	as->resident = 0;
+	as->evicting = 0;
+	as->frames = -1;
+	spinlock_init(&as->frames_lock);
+	as->swap_slots = -1;
+	as->stlb_id = stlb_newid();
+	bzero(as->asid, sizeof(as->asid));	// nessun ASID: verrà assegnato alla prima attivazione su ogni CPU
 	return as;
 }
 
@@ -92,18 +110,37 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 void
 as_destroy(struct addrspace *as)
 {
+	unsigned int c;
+
+	/*
+	* Una CPU passata a un thread di kernel conserva l'ultimo as attivato: il refill non deve più usarne la directory,
+	* e un nuovo as allocato allo stesso indirizzo non deve essere scambiato per quello già attivo.
+	*/
+	for (c=0; c<MAXCPUS; c++) {
+#if !OPT_IPT
+		if (utlb_pgdir[c] == as->pt) {
+			utlb_pgdir[c] = NULL;
+		}
+#endif
+		if (as_last[c] == as) {
+			as_last[c] = NULL;
+		}
+	}
 	cm_asfree(as);
-	pt_free(as->pt);
 	swap_asfree(as);
-	sgm_free(as->segments);
+	sgm_free(&as->segments);
+#if !OPT_IPT
+	pt_free(as->pt);				// foglie e directory
+#endif
 	vfs_close(as->elf_file);
+	spinlock_cleanup(&as->frames_lock);
 	kfree(as);
 }
 
 void
 as_activate(void)
 {
-	int i, spl;
+	int spl, flushed;
 	struct addrspace *as;
 
 	as = proc_getas();
@@ -114,12 +151,27 @@ as_activate(void)
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
-	for (i=0; i<NUM_TLB; i++) {
-		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	if (as_last[curcpu->c_number] == as) {
+		/*
+		* Stesso as dell'ultima attivazione (thread dello stesso processo, o ritorno da un thread di kernel, che non
+		* attiva nessun as): ASID, EntryHi e directory del refill sono ancora quelli giusti.
+		*/
+		splx(spl);
+		vmstats_inc(AS_ACTIVATE_SKIP);
+		return;
 	}
+	as_last[curcpu->c_number] = as;
+
+	// le entry dell'as restano in tlb tra un'attivazione e l'altra: la tlb viene svuotata solo quando finiscono gli ASID
+	flushed = tlb_activate(as->asid);
+#if !OPT_IPT
+	utlb_pgdir[curcpu->c_number] = as->pt;		// da qui i TLB miss vengono risolti dal refill in assembly
+#endif
 
 	splx(spl);
-	vmstats_inc(TLB_INVALID);
+	if (flushed) {
+		vmstats_inc(TLB_INVALID);
+	}
 }
 
 void
@@ -143,10 +195,10 @@ as_deactivate(void)
  * want to implement them.
  */
 int
-as_define_region(struct addrspace *as, vaddr_t vaddr, off_t offset, size_t sz,
+as_define_region(struct addrspace *as, vaddr_t vaddr, off_t offset, size_t sz, size_t filesz,
 		 int readable, int writeable, int executable)
 {
-	size_t npages, i, segsz;
+	size_t npages, segsz;
 	
 	segment_entry* segment;
 	segsz = sz;
@@ -159,57 +211,51 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, off_t offset, size_t sz,
 
 	npages = sz / PAGE_SIZE;
 	
-	segment = sgm_create( vaddr,offset, npages, segsz,readable,writeable,executable, as->segments);
+	segment = sgm_create( vaddr,offset, npages, segsz,filesz,readable,writeable,executable);
 	if(segment ==NULL)
 		return ENOMEM;
 		
-	as->segments = segment;
-	
-	//crea la catena di pt_entry che successivamente sarà inserita nella pt (inserimento in testa)
-	pt_entry* page;
-	pt_entry* page_head;
-	pt_entry* page_tail;
-	
-	for(i=0;i<npages;i++){
-	
-		page = pt_create(vaddr+(i*PAGE_SIZE));
-		if(page==NULL)
-			return ENOMEM;
-	
-		if(i==0){
-			page_head=page;
-			page_tail=page;
-		}
-		else{
-			page_tail->next = (struct pt_entry*)page;
-			page_tail = page;
-		}
+	if(sgm_insert(&as->segments, segment)){
+		kfree(segment->permission);
+		kfree(segment);
+		return ENOMEM;
 	}
 	
-	//collegare al segmento
-	segment->first_pt_entry = page_head;
-	//collegare alla pt dell'as
-	page_tail->next= (struct pt_entry*)as->pt;
-	as->pt = page_head;
-	
-	return 0;	
+#if OPT_ONDEMAND
+	(void)writeable;
+	return 0;					// le foglie della pt vengono allocate al primo fault (con OPT_IPT non ce ne sono)
+#else
+	//alloca le foglie della pt che coprono il segmento
+	return pt_alloc_range(as->pt, vaddr, npages, writeable);
+#endif
 }
 
 int
 as_prepare_load(struct addrspace *as)
 {
-
+#if OPT_IPT
+	(void)as;					// con paginazione on demand (richiesta da OPT_IPT) non viene chiamata
+#else
+	segment_entry* seg;
 	pt_entry* p;
+	vaddr_t vaddr;
+	paddr_t frame;
+	int i, k;
 	
-	p = as->pt;
 	/* allocazione dei frame per le pagine del processo */
-	while(p != NULL){
-		p->frame = frame_alloc(p->page, as);
-		
-		if( p->frame==0 )
-			return ENOMEM;
-		p = (pt_entry*)p->next;
+	for(k=0; k<as->segments.count; k++){
+		seg = as->segments.seg[k];
+		for(i=0; i<seg->npages; i++){
+			vaddr = seg->first_addr + i*PAGE_SIZE;
+			p = pt_lookup(as->pt, vaddr);
+			frame = frame_alloc(vaddr, as, 0);
+			
+			if( frame==0 )
+				return ENOMEM;
+			*p = PTE_MAP(*p, frame, 1);	// sola lettura: la prima scrittura del caricamento passa da vm_fault
+		}
 	}
+#endif
 	
 	return 0;
 }
@@ -234,46 +280,32 @@ as_complete_load(struct addrspace *as)
 int
 as_define_stack(struct addrspace *as, vaddr_t *initstackptr)
 {
-	int i;
 	segment_entry* segment;
 	
 	/* allocazione delle pagine per lo stack */
-	segment = sgm_create( USERSTACK-(DUMBVM_STACKPAGES*PAGE_SIZE),-1,DUMBVM_STACKPAGES,0,4,2,0, as->segments);
+	segment = sgm_create( USERSTACK-(DUMBVM_STACKPAGES*PAGE_SIZE),-1,DUMBVM_STACKPAGES,0,0,4,2,0);
 	if(segment ==NULL)
 		return ENOMEM;
 		
-	as->segments = segment;
-	
-	pt_entry* page;
-	pt_entry* page_head;
-	pt_entry* page_tail;
-	
-	for(i=0;i<DUMBVM_STACKPAGES;i++){
-		page = pt_create(USERSTACK-((i+1)*PAGE_SIZE) );
-		if(page==NULL)
-			return ENOMEM;
-		
-		if(i==0){
-			page_head=page;
-			page_tail=page;
-		}
-		else{
-			page_tail->next = (struct pt_entry*) page;
-			page_tail = page;
-		}
+	if(sgm_insert(&as->segments, segment)){
+		kfree(segment->permission);
+		kfree(segment);
+		return ENOMEM;
 	}
 	
-	segment->first_pt_entry = page_head;
-	page_tail->next = (struct pt_entry*) as->pt;
-	as->pt = page_head;
 #if !OPT_ONDEMAND
-	page = segment->first_pt_entry;
+	if(pt_alloc_range(as->pt, segment->first_addr, DUMBVM_STACKPAGES, 1))
+		return ENOMEM;
+	int i;
+	pt_entry* page;
+	paddr_t frame;
 	for(i=0; i<DUMBVM_STACKPAGES;i++){
-		page->frame = frame_alloc(page->page, as);
+		page = pt_lookup(as->pt, segment->first_addr + i*PAGE_SIZE);
+		frame = frame_alloc(segment->first_addr + i*PAGE_SIZE, as, 0);
 		
-		if( page->frame==0 )
+		if( frame==0 )
 			return ENOMEM;
-		page = (pt_entry*)page->next;
+		*page = PTE_MAP(*page, frame, 1);
 	}
 #endif	
 	
@@ -395,9 +427,9 @@ as_prepare_load(struct addrspace *as)
 	unsigned int i;
 	for(i=0;i<as->as_npages1;i++){
 		if(i==0){
-			as->as_pbase1 = frame_alloc(as->as_vbase1,as);	
+			as->as_pbase1 = frame_alloc(as->as_vbase1,as,0);	
 		}
-		frame_alloc(as->as_vbase1+(PAGE_SIZE*i),as);
+		frame_alloc(as->as_vbase1+(PAGE_SIZE*i),as,0);
 	}
 	
 	//as->as_pbase1 = getppages(as->as_npages1);
@@ -408,9 +440,9 @@ as_prepare_load(struct addrspace *as)
 
 	for(i=0;i<as->as_npages2;i++){
 		if(i==0){
-			as->as_pbase2 = frame_alloc(as->as_vbase2,as);	
+			as->as_pbase2 = frame_alloc(as->as_vbase2,as,0);	
 		}
-		frame_alloc(as->as_vbase2+(PAGE_SIZE*i),as);
+		frame_alloc(as->as_vbase2+(PAGE_SIZE*i),as,0);
 	}
 	
 	//as->as_pbase2 = getppages(as->as_npages2);
@@ -420,9 +452,9 @@ as_prepare_load(struct addrspace *as)
 
 	for(i=0;i<DUMBVM_STACKPAGES;i++){
 		if(i==0){
-			as->as_stackpbase = frame_alloc(USERSTACK,as);	
+			as->as_stackpbase = frame_alloc(USERSTACK,as,0);	
 		}
-		frame_alloc(USERSTACK-(PAGE_SIZE*i),as);
+		frame_alloc(USERSTACK-(PAGE_SIZE*i),as,0);
 	}
 	//as->as_stackpbase = getppages(DUMBVM_STACKPAGES);
 	if (as->as_stackpbase == 0) {
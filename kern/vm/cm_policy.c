@@ -0,0 +1,495 @@
+#include "cm_policy.h"
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include "coremap.h"
+#include "vm_stats.h"
+
+/*
+* 	FIFO - vittima è il frame candidato caricato da più tempo (timestamp minimo). Scansione completa della coremap.
+*/
+static int fifo_select(struct addrspace* as){
+	unsigned int i, n, min;
+	int min_pos = -1;
+
+	n = cm_nframes();
+	min = cm_now();
+	for(i=0; i<n; i++){
+		if(coremap[i].timestamp < min && cm_is_candidate(i, as)){
+			min = coremap[i].timestamp;
+			min_pos = i;
+		}
+	}
+	return min_pos;
+}
+
+static struct cm_policy fifo_policy = {
+	"fifo", NULL, NULL, fifo_select, NULL, NULL, NULL, {0}
+};
+
+/*
+* 	Clock - seconda possibilità: la lancetta scorre la coremap a partire da dove si era fermata. Un frame con bit di
+*		riferimento a 1 viene risparmiato e il bit azzerato; il primo frame con bit a 0 è la vittima.
+*/
+static unsigned int clock_hand;
+
+static int clock_select(struct addrspace* as){
+	unsigned int i, n, pos;
+
+	n = cm_nframes();
+	for(i=0; i<2*n; i++){				// dopo un giro completo tutti i bit dei candidati sono a 0
+		pos = clock_hand;
+		clock_hand = (clock_hand+1) % n;
+		if(!cm_is_candidate(pos, as)){
+			continue;
+		}
+		if(coremap[pos].ref){
+			coremap[pos].ref = 0;
+			cm_policy_stat(REPL_SECOND_CHANCE);
+			continue;
+		}
+		return pos;
+	}
+	return -1;
+}
+
+static struct cm_policy clock_policy = {
+	"clock", NULL, NULL, clock_select, NULL, NULL, NULL, {0}
+};
+
+/*
+* 	WSClock - come Clock, ma un frame con bit a 0 è scelto solo se è fuori dal working set, cioè se non è stato
+*		  riferito negli ultimi WSCLOCK_TAU istanti di tempo virtuale. Il tempo dell'ultimo riferimento osservato è in
+*		  ref_time e non in timestamp, che resta l'istante di caricamento: passando a FIFO con vmpolicy l'ordine di
+*		  caricamento è intatto. Se tutti i candidati sono nel working set si sceglie il meno recente.
+*/
+static unsigned int wsclock_hand;
+
+static int wsclock_select(struct addrspace* as){
+	unsigned int i, n, pos, now;
+	int oldest = -1;
+
+	n = cm_nframes();
+	now = cm_now();
+	for(i=0; i<2*n; i++){
+		pos = wsclock_hand;
+		wsclock_hand = (wsclock_hand+1) % n;
+		if(!cm_is_candidate(pos, as)){
+			continue;
+		}
+		if(coremap[pos].ref){
+			coremap[pos].ref = 0;
+			coremap[pos].ref_time = now;
+			cm_policy_stat(REPL_SECOND_CHANCE);
+			continue;
+		}
+		if(now - coremap[pos].ref_time > WSCLOCK_TAU){
+			return pos;
+		}
+		if(oldest < 0 || coremap[pos].ref_time < coremap[oldest].ref_time){
+			oldest = pos;
+		}
+	}
+	return oldest;
+}
+
+static struct cm_policy wsclock_policy = {
+	"wsclock", NULL, NULL, wsclock_select, NULL, NULL, NULL, {0}
+};
+
+/*
+* 	CAR (Clock with Adaptive Replacement) - versione a clock di ARC.
+*
+*	T1 contiene i frame riferiti una sola volta dal caricamento, T2 quelli riferiti almeno due volte. Entrambe sono liste
+*	circolari di frame (collegate con next_free/prev_free, che un frame in memoria non usa) percorse da una lancetta.
+*	B1 e B2 ricordano (as, vaddr) delle pagine espulse rispettivamente da T1 e da T2. Una pagina ricaricata mentre è in
+*	B1 indica che T1 è troppo piccola e fa crescere il target car_p di T1; una pagina trovata in B2 lo fa diminuire.
+*	car_map cerca la pagina nelle liste fantasma a ogni caricamento: le entry valide sono indicizzate da una tabella hash
+*	su (as, vaddr) comune a B1 e B2, così la ricerca sotto cm_lock non dipende dal numero di frame.
+*/
+#define CAR_T1 1
+#define CAR_T2 2
+
+struct car_ghost{
+	struct addrspace* as;		// NULL se la entry è stata tolta
+	vaddr_t vaddr;
+	int hnext;			// entry successiva nella catena hash, -1 se ultima
+};
+
+struct car_ghostlist{
+	struct car_ghost* entries;	// buffer circolare, dal più vecchio al più recente
+	unsigned int first;		// posizione della entry più vecchia
+	unsigned int used;		// entry occupate nel buffer, comprese quelle tolte
+	unsigned int size;		// entry valide
+};
+
+static int car_head[3] = {-1, -1, -1};	// lancetta di T1 e T2 (indice 0 non usato)
+static unsigned int car_size[3];
+static unsigned int car_p;		// dimensione target di T1
+static unsigned int car_c;		// numero di frame gestiti
+static struct car_ghostlist car_b1, car_b2;
+static struct car_ghost* car_ghosts;	// entry di B1 seguite da quelle di B2
+static int* car_hash;			// prima entry di ogni catena, -1 se vuota
+static unsigned int car_hash_mask;	// numero di catene - 1 (potenza di 2)
+
+/*
+* 	car_insert - inserisce pos in coda alla lista l, cioè subito prima della lancetta.
+*/
+static void car_insert(unsigned int pos, unsigned int l){
+	int head = car_head[l];
+
+	coremap[pos].list = l;
+	if(head < 0){
+		coremap[pos].next_free = pos;
+		coremap[pos].prev_free = pos;
+		car_head[l] = pos;
+	}
+	else{
+		coremap[pos].next_free = head;
+		coremap[pos].prev_free = coremap[head].prev_free;
+		coremap[coremap[head].prev_free].next_free = pos;
+		coremap[head].prev_free = pos;
+	}
+	car_size[l]++;
+}
+/*
+* 	car_remove - toglie pos dalla sua lista. La lancetta, se puntava a pos, passa al frame successivo.
+*/
+static void car_remove(unsigned int pos){
+	unsigned int l = coremap[pos].list;
+
+	if(l == 0){
+		return;
+	}
+	if(coremap[pos].next_free == (int)pos){
+		car_head[l] = -1;
+	}
+	else{
+		coremap[coremap[pos].prev_free].next_free = coremap[pos].next_free;
+		coremap[coremap[pos].next_free].prev_free = coremap[pos].prev_free;
+		if(car_head[l] == (int)pos){
+			car_head[l] = coremap[pos].next_free;
+		}
+	}
+	coremap[pos].next_free = -1;
+	coremap[pos].prev_free = -1;
+	coremap[pos].list = 0;
+	car_size[l]--;
+}
+/*
+* 	ghost_bucket - catena hash di (as, vaddr).
+*/
+static unsigned int ghost_bucket(struct addrspace* as, vaddr_t vaddr){
+	unsigned int h;
+
+	h = ((unsigned int)(uintptr_t)as >> 4) ^ (vaddr / PAGE_SIZE);
+	h *= 2654435761U;
+	return (h ^ (h >> 16)) & car_hash_mask;
+}
+/*
+* 	ghost_link - aggiunge la entry alla sua catena hash.
+*/
+static void ghost_link(struct car_ghost* e){
+	unsigned int b = ghost_bucket(e->as, e->vaddr);
+
+	e->hnext = car_hash[b];
+	car_hash[b] = e - car_ghosts;
+}
+/*
+* 	ghost_unlink - toglie la entry dalla sua catena hash e la segna come tolta.
+*/
+static void ghost_unlink(struct car_ghost* e){
+	int* p = &car_hash[ghost_bucket(e->as, e->vaddr)];
+
+	while(&car_ghosts[*p] != e){
+		KASSERT(*p >= 0);
+		p = &car_ghosts[*p].hnext;
+	}
+	*p = e->hnext;
+	e->as = NULL;
+}
+/*
+* 	ghost_reset
+*/
+static void ghost_reset(struct car_ghostlist* g){
+	g->first = 0;
+	g->used = 0;
+	g->size = 0;
+}
+/*
+* 	ghost_pop - dimentica la entry valida più vecchia.
+*/
+static void ghost_pop(struct car_ghostlist* g){
+	struct car_ghost* e;
+
+	while(g->used > 0){
+		e = &g->entries[g->first];
+		g->first = (g->first+1) % car_c;
+		g->used--;
+		if(e->as != NULL){
+			ghost_unlink(e);
+			g->size--;
+			return;
+		}
+	}
+}
+/*
+* 	ghost_push - ricorda la pagina espulsa (as, vaddr). Se il buffer è pieno la entry più vecchia viene sovrascritta.
+*/
+static void ghost_push(struct car_ghostlist* g, struct addrspace* as, vaddr_t vaddr){
+	struct car_ghost* e;
+
+	if(g->used == car_c){
+		e = &g->entries[g->first];
+		if(e->as != NULL){
+			ghost_unlink(e);
+			g->size--;
+		}
+		g->first = (g->first+1) % car_c;
+		g->used--;
+	}
+	e = &g->entries[(g->first + g->used) % car_c];
+	e->as = as;
+	e->vaddr = vaddr;
+	ghost_link(e);
+	g->used++;
+	g->size++;
+}
+/*
+* 	ghost_take - se (as, vaddr) è nella lista la toglie e restituisce 1.
+*/
+static int ghost_take(struct car_ghostlist* g, struct addrspace* as, vaddr_t vaddr){
+	int i;
+	struct car_ghost* e;
+
+	for(i=car_hash[ghost_bucket(as, vaddr)]; i>=0; i=e->hnext){
+		e = &car_ghosts[i];
+		if(e->as == as && e->vaddr == vaddr && e >= g->entries && e < g->entries + car_c){
+			ghost_unlink(e);
+			g->size--;
+			return 1;
+		}
+	}
+	return 0;
+}
+/*
+* 	ghost_forget - toglie tutte le pagine di un address space distrutto.
+*/
+static void ghost_forget(struct car_ghostlist* g, struct addrspace* as){
+	unsigned int i;
+	struct car_ghost* e;
+
+	for(i=0; i<g->used; i++){
+		e = &g->entries[(g->first+i) % car_c];
+		if(e->as == as){
+			ghost_unlink(e);
+			g->size--;
+		}
+	}
+}
+/*
+* 	car_prepare - alloca le liste fantasma, una entry per frame in ciascuna, e le catene hash.
+*/
+static int car_prepare(void){
+	unsigned int n = cm_nframes();
+	unsigned int nbuckets = 1;
+
+	if(car_ghosts != NULL){
+		return 0;
+	}
+	while(nbuckets < n){
+		nbuckets <<= 1;
+	}
+	car_ghosts = kmalloc(2*n*sizeof(struct car_ghost));
+	car_hash = kmalloc(nbuckets*sizeof(int));
+	if(car_ghosts == NULL || car_hash == NULL){
+		kfree(car_ghosts);
+		kfree(car_hash);
+		car_ghosts = NULL;
+		car_hash = NULL;
+		return ENOMEM;
+	}
+	car_hash_mask = nbuckets-1;
+	car_b1.entries = car_ghosts;
+	car_b2.entries = car_ghosts + n;
+	return 0;
+}
+/*
+* 	car_start - i frame già in memoria entrano tutti in T1, le liste fantasma partono vuote.
+*/
+static void car_start(void){
+	unsigned int i;
+
+	car_c = cm_nframes();
+	car_p = 0;
+	car_head[CAR_T1] = car_head[CAR_T2] = -1;
+	car_size[CAR_T1] = car_size[CAR_T2] = 0;
+	ghost_reset(&car_b1);
+	ghost_reset(&car_b2);
+	for(i=0; i<=car_hash_mask; i++){
+		car_hash[i] = -1;
+	}
+	for(i=0; i<car_c; i++){
+		coremap[i].list = 0;
+		if((coremap[i].state == CLEAN || coremap[i].state == DIRTY) && coremap[i].as != NULL){
+			car_insert(i, CAR_T1);
+		}
+	}
+}
+/*
+* 	car_map - una pagina appena caricata entra in T1, o in T2 se era in una lista fantasma (adattando car_p).
+*/
+static void car_map(unsigned int pos){
+	struct addrspace* as = coremap[pos].as;
+	vaddr_t vaddr = coremap[pos].virt_addr;
+	unsigned int delta;
+
+	KASSERT(coremap[pos].list == 0);
+	coremap[pos].ref = 0;
+
+	if(car_b1.size > 0 && ghost_take(&car_b1, as, vaddr)){
+		delta = (car_b2.size > car_b1.size+1) ? car_b2.size/(car_b1.size+1) : 1;
+		car_p = (car_p+delta < car_c) ? car_p+delta : car_c;
+		cm_policy_stat(REPL_GHOST_HIT);
+		car_insert(pos, CAR_T2);
+		return;
+	}
+	if(car_b2.size > 0 && ghost_take(&car_b2, as, vaddr)){
+		delta = (car_b1.size > car_b2.size+1) ? car_b1.size/(car_b2.size+1) : 1;
+		car_p = (car_p > delta) ? car_p-delta : 0;
+		cm_policy_stat(REPL_GHOST_HIT);
+		car_insert(pos, CAR_T2);
+		return;
+	}
+	// pagina mai vista: la storia non può superare c pagine per T1+B1 e 2c in totale
+	if(car_size[CAR_T1] + car_b1.size >= car_c){
+		ghost_pop(&car_b1);
+	}
+	else if(car_size[CAR_T1] + car_size[CAR_T2] + car_b1.size + car_b2.size >= 2*car_c){
+		ghost_pop(&car_b2);
+	}
+	car_insert(pos, CAR_T1);
+}
+/*
+* 	car_select - la lancetta di T1 gira finché T1 supera il target car_p, altrimenti quella di T2. In T1 un frame
+*		     riferito passa in T2, in T2 riceve una seconda possibilità. La vittima finisce nella lista fantasma.
+*/
+static int car_select(struct addrspace* as){
+	unsigned int l, tries;
+	int pos;
+
+	for(tries = 2*(car_size[CAR_T1]+car_size[CAR_T2])+2; tries > 0; tries--){
+		if(car_size[CAR_T1] == 0 && car_size[CAR_T2] == 0){
+			break;
+		}
+		l = (car_size[CAR_T1] > 0 && (car_size[CAR_T1] >= car_p || car_size[CAR_T2] == 0)) ? CAR_T1 : CAR_T2;
+		pos = car_head[l];
+		if(!cm_is_candidate(pos, as)){
+			car_head[l] = coremap[pos].next_free;
+			continue;
+		}
+		if(coremap[pos].ref){
+			coremap[pos].ref = 0;
+			cm_policy_stat(REPL_SECOND_CHANCE);
+			if(l == CAR_T1){
+				car_remove(pos);
+				car_insert(pos, CAR_T2);
+			}
+			else{
+				car_head[l] = coremap[pos].next_free;
+			}
+			continue;
+		}
+		car_remove(pos);
+		ghost_push(l == CAR_T1 ? &car_b1 : &car_b2, coremap[pos].as, coremap[pos].virt_addr);
+		return pos;
+	}
+	/*
+	* Nessun candidato nelle liste raggiunte dalle lancette (ad esempio con politica locale e frame del processo
+	* tutti nell'altra lista): si ripiega su FIFO.
+	*/
+	pos = fifo_select(as);
+	if(pos >= 0){
+		car_remove(pos);
+	}
+	return pos;
+}
+/*
+* 	car_unmap
+*/
+static void car_unmap(unsigned int pos){
+	car_remove(pos);
+}
+/*
+* 	car_asfree
+*/
+static void car_asfree(struct addrspace* as){
+	if(car_ghosts == NULL){
+		return;
+	}
+	ghost_forget(&car_b1, as);
+	ghost_forget(&car_b2, as);
+}
+
+static struct cm_policy car_policy = {
+	"car", car_prepare, car_start, car_select, car_map, car_unmap, car_asfree, {0}
+};
+
+static struct cm_policy* policies[] = {
+	&fifo_policy, &clock_policy, &wsclock_policy, &car_policy, NULL
+};
+
+/*
+* 	cm_policy_lookup
+*/
+struct cm_policy* cm_policy_lookup(const char* name){
+	unsigned int i;
+
+	for(i=0; policies[i] != NULL; i++){
+		if(!strcmp(policies[i]->name, name)){
+			return policies[i];
+		}
+	}
+	return NULL;
+}
+/*
+* 	cm_policy_list
+*/
+void cm_policy_list(void){
+	unsigned int i;
+
+	for(i=0; policies[i] != NULL; i++){
+		kprintf("%s%s", i ? " " : "", policies[i]->name);
+	}
+	kprintf("\n");
+}
+/*
+* 	cm_policy_print_stats - le politiche mai attivate (tutti i contatori a 0) non vengono stampate
+*/
+void cm_policy_print_stats(void){
+	unsigned int i, j, used;
+
+	kprintf("replacement per policy (hits/misses/second chances/ghost hits):\n");
+	for(i=0; policies[i] != NULL; i++){
+		used = 0;
+		for(j=0; j<CM_POLICY_STATS; j++){
+			used |= policies[i]->stats[j];
+		}
+		if(!used){
+			continue;
+		}
+		kprintf("  %-8s %u/%u/%u/%u\n", policies[i]->name, policies[i]->stats[0], policies[i]->stats[1],
+			policies[i]->stats[2], policies[i]->stats[3]);
+	}
+}
+/*
+* 	cm_policy_shutdown
+*/
+void cm_policy_shutdown(void){
+	kfree(car_ghosts);
+	kfree(car_hash);
+	car_ghosts = NULL;
+	car_hash = NULL;
+	car_b1.entries = NULL;
+	car_b2.entries = NULL;
+}
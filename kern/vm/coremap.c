@@ -1,7 +1,14 @@
 #include "coremap.h"
+#include "cm_policy.h"
+#include "vm_stats.h"
+#include "swap.h"
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <current.h>
+#include <membar.h>
+#include <thread.h>
+#include <wchan.h>
 /* 		
 * 	Coremap - Data structures
 *	
@@ -11,19 +18,446 @@ static struct spinlock cm_lock = SPINLOCK_INITIALIZER;
 
 static unsigned int ram_frames;
 static unsigned int timestamp;
+static struct spinlock stamp_lock = SPINLOCK_INITIALIZER;	// protegge timestamp: frame_alloc e frame_kalloc(1) non acquisiscono cm_lock
 
 static paddr_t firstpaddr;
 static paddr_t lastpaddr;
 int bootstrapped = 0 ;
 cm_entry* coremap;
 
+static int free_area[CM_MAX_ORDER+1];	// teste delle liste dei blocchi liberi, una per ordine
+static unsigned int free_blocks[CM_MAX_ORDER+1];	// numero di blocchi liberi per ciascun ordine
+static unsigned int free_frames;	// frame liberi nelle liste del buddy allocator (con quelli delle magazine: cm_free_count)
+static unsigned int kalloc_fails;	// richieste di frame_kalloc non soddisfatte
+
+static struct cm_magazine cm_magazines[MAXCPUS];	// cache per-CPU di frame singoli liberi
+
+static int repl_mode = CM_REPL_DEFAULT;	// politica di rimpiazzamento: locale al processo o globale
+static unsigned int reclaim_hand;	// frame da cui cm_reclaim_slot riprende la ricerca (cm_lock)
+static int evict_any;			// 1 durante l'ultimo tentativo di cm_evict: ogni frame CLEAN o DIRTY è candidato (cm_lock)
+static struct cm_policy* policy;	// politica con cui viene scelta la vittima
+static struct spinlock policy_stats_lock = SPINLOCK_INITIALIZER;	// protegge i contatori stats delle politiche
+
+static struct wchan* pageout_wchan;	// il pageout daemon dorme qui finché ci sono abbastanza frame liberi
+static int pageout_sleeping;		// 1 se il pageout daemon è in attesa su pageout_wchan
+
+static int zero_pool[CM_ZERO_POOL];	// frame liberi già azzerati: stato FREE ma fuori dal buddy allocator
+static unsigned int zero_count;		// frame nel pool
+static struct wchan* zero_wchan;	// il thread pagezero dorme qui finché il pool è pieno almeno a metà
+static int zero_sleeping;		// 1 se il thread pagezero è in attesa su zero_wchan
+
+#if OPT_IPT
+static int* ipt_hash;			// teste delle catene della page table invertita (indici nella coremap, -1 se vuota)
+static unsigned int ipt_mask;		// numero di teste - 1
+static struct spinlock ipt_lock = SPINLOCK_INITIALIZER;	// protegge teste e catene (ipt_next)
+#endif
+
+static unsigned int cm_lock_acquired;	// numero di acquisizioni di cm_lock
+static unsigned int cm_lock_contended;	// acquisizioni in cui cm_lock era già posseduto da un'altra CPU
+
+/* 		
+* 	cm_lock_acquire - acquisisce cm_lock contando le acquisizioni e quelle in cui il lock era conteso.
+*/
+static void cm_lock_acquire(void){
+	int contended;
+
+	contended = spinlock_data_get(&cm_lock.splk_lock) != 0;
+	spinlock_acquire(&cm_lock);
+	cm_lock_acquired++;
+	if(contended){
+		cm_lock_contended++;
+	}
+}
+
+/* 		
+* 	cm_stamp - nuovo timestamp, unico e crescente anche tra allocazioni concorrenti su CPU diverse.
+*/
+static unsigned int cm_stamp(void){
+	unsigned int t;
+
+	spinlock_acquire(&stamp_lock);
+	t = timestamp++;
+	spinlock_release(&stamp_lock);
+	return t;
+}
+/* 		
+* 	cm_free_count - frame liberi nel buddy allocator e nelle magazine. Le magazine delle altre CPU sono lette senza il
+*		        loro lock: il valore è indicativo, come serve al pageout daemon e al thread pagezero.
+*/
+static unsigned int cm_free_count(void){
+	unsigned int i, n = free_frames;
+
+	for(i=0; i<MAXCPUS; i++){
+		n += cm_magazines[i].count;
+	}
+	return n;
+}
+/* 		
+* 	pageout_check - sveglia il pageout daemon se i frame liberi sono scesi sotto CM_FREE_LOW. Da chiamare con cm_lock acquisito.
+*/
+static void pageout_check(void){
+	if(pageout_sleeping && cm_free_count() < CM_FREE_LOW){
+		pageout_sleeping = 0;
+		wchan_wakeone(pageout_wchan, &cm_lock);
+	}
+}
+/* 		
+* 	freelist_push - inserisce in testa alla lista dei blocchi liberi di ordine order. Da chiamare con cm_lock acquisito.
+*/
+static void freelist_push(unsigned int pos, unsigned int order){
+	coremap[pos].npages = 1 << order;	// per un blocco libero npages indica la dimensione del blocco (solo nel primo frame)
+	coremap[pos].prev_free = -1;
+	coremap[pos].next_free = free_area[order];
+	if(free_area[order] >= 0){
+		coremap[free_area[order]].prev_free = pos;
+	}
+	free_area[order] = pos;
+	free_blocks[order]++;
+	free_frames += 1 << order;
+}
+/* 		
+* 	freelist_remove - toglie un blocco dalla lista dei blocchi liberi di ordine order. Da chiamare con cm_lock acquisito.
+*/
+static void freelist_remove(unsigned int pos, unsigned int order){
+	if(coremap[pos].prev_free >= 0){
+		coremap[coremap[pos].prev_free].next_free = coremap[pos].next_free;
+	}
+	else{
+		free_area[order] = coremap[pos].next_free;
+	}
+	if(coremap[pos].next_free >= 0){
+		coremap[coremap[pos].next_free].prev_free = coremap[pos].prev_free;
+	}
+	coremap[pos].next_free = -1;
+	coremap[pos].prev_free = -1;
+	coremap[pos].npages = 0;
+	free_blocks[order]--;
+	free_frames -= 1 << order;
+}
+/* 		
+* 	buddy_order - ordine del più piccolo blocco che contiene nframes frame.
+*/
+static unsigned int buddy_order(unsigned int nframes){
+	unsigned int order = 0;
+	while((1U << order) < nframes){
+		order++;
+	}
+	return order;
+}
+/* 		
+* 	buddy_alloc - preleva un blocco di ordine order, dividendo un blocco più grande se necessario.
+*		      Restituisce l'indice del primo frame o -1. Da chiamare con cm_lock acquisito.
+*/
+static int buddy_alloc(unsigned int order){
+	unsigned int k;
+	int pos;
+
+	for(k=order; k<=CM_MAX_ORDER && free_area[k] < 0; k++);
+	if(k > CM_MAX_ORDER){
+		return -1;
+	}
+	pos = free_area[k];
+	freelist_remove(pos, k);
+	while(k > order){			// la metà superiore torna libera come blocco di ordine k-1
+		k--;
+		freelist_push(pos + (1 << k), k);
+	}
+	return pos;
+}
+/* 		
+* 	buddy_free - libera il blocco di ordine order che parte da pos, fondendolo con il buddy finché possibile.
+*		     I frame del blocco devono essere già FREE. Da chiamare con cm_lock acquisito.
+*/
+static void buddy_free(unsigned int pos, unsigned int order){
+	unsigned int buddy;
+
+	while(order < CM_MAX_ORDER){
+		buddy = pos ^ (1 << order);
+		if(buddy + (1 << order) > ram_frames){
+			break;
+		}
+		// il buddy è fondibile solo se è l'inizio di un blocco libero dello stesso ordine
+		if(coremap[buddy].state != FREE || coremap[buddy].npages != (1 << order)){
+			break;
+		}
+		freelist_remove(buddy, order);
+		if(buddy < pos){
+			pos = buddy;
+		}
+		order++;
+	}
+	freelist_push(pos, order);
+}
+/* 		
+* 	free_range - libera npages frame consecutivi a partire da pos. L'intervallo viene scomposto in blocchi allineati,
+*		     ognuno dei quali viene restituito al buddy allocator. Da chiamare con cm_lock acquisito.
+*/
+static void free_range(unsigned int pos, unsigned int npages){
+	unsigned int order, j;
+
+	while(npages > 0){
+		order = 0;
+		while(order < CM_MAX_ORDER && (pos & (1 << order)) == 0 && (2U << order) <= npages){
+			order++;
+		}
+		for(j=pos; j<pos+(1 << order); j++){
+			coremap[j].state = FREE;
+			coremap[j].as = NULL;
+			coremap[j].npages = 0;
+			coremap[j].virt_addr = 0; 
+			coremap[j].timestamp = -1;
+			coremap[j].ref = 0;
+			coremap[j].next_free = -1;
+			coremap[j].prev_free = -1;
+		}
+		buddy_free(pos, order);
+		pos += 1 << order;
+		npages -= 1 << order;
+	}
+}
+/* 		
+* 	rmap_insert - inserisce il frame pos nella lista dei frame in memoria di as. resident cambia insieme alla lista,
+*		      con frames_lock.
+*/
+static void rmap_insert(struct addrspace* as, unsigned int pos){
+	spinlock_acquire(&as->frames_lock);
+	as->resident++;
+	coremap[pos].as_prev = -1;
+	coremap[pos].as_next = as->frames;
+	if(as->frames >= 0){
+		coremap[as->frames].as_prev = pos;
+	}
+	as->frames = pos;
+	spinlock_release(&as->frames_lock);
+}
+/* 		
+* 	rmap_remove - toglie il frame pos dalla lista dei frame in memoria di as.
+*/
+static void rmap_remove(struct addrspace* as, unsigned int pos){
+	spinlock_acquire(&as->frames_lock);
+	as->resident--;
+	if(coremap[pos].as_prev >= 0){
+		coremap[coremap[pos].as_prev].as_next = coremap[pos].as_next;
+	}
+	else{
+		as->frames = coremap[pos].as_next;
+	}
+	if(coremap[pos].as_next >= 0){
+		coremap[coremap[pos].as_next].as_prev = coremap[pos].as_prev;
+	}
+	coremap[pos].as_next = -1;
+	coremap[pos].as_prev = -1;
+	spinlock_release(&as->frames_lock);
+}
+#if OPT_IPT
+/* 		
+* 	ipt_bootstrap - alloca le teste della page table invertita, almeno una per frame. Va chiamata quando kmalloc
+*			usa già la coremap.
+*/
+static void ipt_bootstrap(void){
+	unsigned int i, n = 1;
+
+	while(n < ram_frames){
+		n <<= 1;
+	}
+	ipt_hash = kmalloc(n*sizeof(int));
+	if(ipt_hash == NULL){
+		panic("Cannot allocate the inverted page table\n");
+	}
+	for(i=0; i<n; i++){
+		ipt_hash[i] = -1;
+	}
+	ipt_mask = n-1;
+}
+/* 		
+* 	ipt_insert - inserisce il frame pos, appena assegnato a una pagina (as e virt_addr già scritti), nella page table invertita.
+*/
+static void ipt_insert(unsigned int pos){
+	unsigned int h = IPT_HASH(coremap[pos].as, coremap[pos].virt_addr, ipt_mask);
+
+	spinlock_acquire(&ipt_lock);
+	coremap[pos].ipt_as = coremap[pos].as;
+	coremap[pos].ipt_vaddr = coremap[pos].virt_addr;
+	coremap[pos].ipt_next = ipt_hash[h];
+	ipt_hash[h] = pos;
+	spinlock_release(&ipt_lock);
+}
+/* 		
+* 	ipt_remove - toglie il frame pos dalla sua catena. Le catene sono lunghe in media meno di un frame.
+*/
+static void ipt_remove(unsigned int pos){
+	unsigned int h = IPT_HASH(coremap[pos].ipt_as, coremap[pos].ipt_vaddr, ipt_mask);
+	int* link;
+
+	spinlock_acquire(&ipt_lock);
+	for(link=&ipt_hash[h]; *link>=0 && *link!=(int)pos; link=&coremap[*link].ipt_next);
+	KASSERT(*link == (int)pos);
+	*link = coremap[pos].ipt_next;
+	coremap[pos].ipt_as = NULL;
+	coremap[pos].ipt_vaddr = 0;
+	coremap[pos].ipt_next = -1;
+	spinlock_release(&ipt_lock);
+}
+#endif
+/* 		
+* 	mag_drain - restituisce al buddy allocator i frame di tutte le magazine. Chiamata quando il buddy allocator non ha
+*		    frame: quelli nelle magazine delle altre CPU non sarebbero raggiungibili e frammenterebbero i blocchi.
+*		    Restituisce il numero di frame restituiti.
+*/
+static unsigned int mag_drain(void){
+	struct cm_magazine* mag;
+	unsigned int i, n = 0;
+
+	for(i=0; i<MAXCPUS; i++){
+		mag = &cm_magazines[i];
+		spinlock_acquire(&mag->lock);
+		if(mag->count > 0){
+			cm_lock_acquire();
+			while(mag->count > 0){
+				free_range(mag->frames[--mag->count], 1);
+				n++;
+			}
+			spinlock_release(&cm_lock);
+		}
+		spinlock_release(&mag->lock);
+	}
+	return n;
+}
+/* 		
+* 	mag_get - preleva un frame singolo dalla magazine della CPU corrente. Se la magazine è vuota viene ricaricata con
+*		  CM_MAG_BATCH frame presi dal buddy allocator con una sola acquisizione di cm_lock; se anche il buddy allocator
+*		  è vuoto si svuotano le magazine delle altre CPU. Restituisce -1 se non ci sono frame liberi. Il frame
+*		  restituito ha stato FREE ma non è in nessuna lista: appartiene al chiamante.
+*/
+static int mag_get(void){
+	struct cm_magazine* mag;
+	int pos;
+
+	if(!CM_MAGAZINES || !CURCPU_EXISTS()){
+		cm_lock_acquire();
+		pos = buddy_alloc(0);
+		pageout_check();
+		spinlock_release(&cm_lock);
+		return pos;
+	}
+
+	// se il thread cambia CPU prima del lock usa la magazine di un'altra CPU: resta corretto, il lock la protegge
+	mag = &cm_magazines[curcpu->c_number];
+	spinlock_acquire(&mag->lock);
+	if(mag->count == 0){
+		cm_lock_acquire();
+		while(mag->count < CM_MAG_BATCH){
+			pos = buddy_alloc(0);
+			if(pos < 0){
+				break;
+			}
+			mag->frames[mag->count++] = pos;
+		}
+		pageout_check();
+		spinlock_release(&cm_lock);
+	}
+	pos = (mag->count > 0) ? mag->frames[--mag->count] : -1;
+	spinlock_release(&mag->lock);
+	if(pos < 0 && mag_drain() > 0){
+		cm_lock_acquire();
+		pos = buddy_alloc(0);
+		spinlock_release(&cm_lock);
+	}
+	return pos;
+}
+/* 		
+* 	mag_put - restituisce un frame singolo alla magazine della CPU corrente. Se la magazine è piena, CM_MAG_BATCH 
+*		  frame tornano al buddy allocator con una sola acquisizione di cm_lock.
+*/
+static void mag_put(unsigned int pos){
+	struct cm_magazine* mag;
+
+	coremap[pos].state = FREE;
+	coremap[pos].as = NULL;
+	coremap[pos].npages = 0;
+	coremap[pos].virt_addr = 0; 
+	coremap[pos].timestamp = -1;
+
+	if(!CM_MAGAZINES || !CURCPU_EXISTS()){
+		cm_lock_acquire();
+		free_range(pos, 1);
+		spinlock_release(&cm_lock);
+		return;
+	}
+
+	mag = &cm_magazines[curcpu->c_number];
+	spinlock_acquire(&mag->lock);
+	if(mag->count == CM_MAG_SIZE){
+		cm_lock_acquire();
+		while(mag->count > CM_MAG_SIZE - CM_MAG_BATCH){
+			free_range(mag->frames[--mag->count], 1);
+		}
+		spinlock_release(&cm_lock);
+	}
+	mag->frames[mag->count++] = pos;
+	spinlock_release(&mag->lock);
+}
+/* 		
+* 	zero_check - sveglia il thread pagezero se il pool è sotto la metà. Da chiamare con cm_lock acquisito.
+*/
+static void zero_check(void){
+	if(zero_sleeping && zero_count < CM_ZERO_POOL/2){
+		zero_sleeping = 0;
+		wchan_wakeone(zero_wchan, &cm_lock);
+	}
+}
+/* 		
+* 	zero_pool_get - preleva un frame dal pool dei frame azzerati, svegliando il thread pagezero se il pool scende sotto
+*		        la metà. Restituisce -1 se il pool è vuoto.
+*/
+static int zero_pool_get(void){
+	int pos = -1;
+
+	if(zero_count == 0){				// lettura senza lock: evita cm_lock quando il pool è vuoto
+		return -1;
+	}
+	cm_lock_acquire();
+	if(zero_count > 0){
+		pos = zero_pool[--zero_count];
+		zero_check();
+	}
+	spinlock_release(&cm_lock);
+	return pos;
+}
+/* 		
+* 	freelist_init - costruisce le liste dei blocchi liberi a partire dalle sequenze di frame FREE.
+*/
+static void freelist_init(void){
+	unsigned int i, first;
+
+	for(i=0; i<=CM_MAX_ORDER; i++){
+		free_area[i] = -1;
+		free_blocks[i] = 0;
+	}
+	free_frames = 0;
+	kalloc_fails = 0;
+	zero_count = 0;
+	for(i=0; i<MAXCPUS; i++){
+		cm_magazines[i].count = 0;
+		spinlock_init(&cm_magazines[i].lock);
+	}
+	for(i=0; i<ram_frames; ){
+		if(coremap[i].state != FREE){
+			i++;
+			continue;
+		}
+		for(first=i; i<ram_frames && coremap[i].state == FREE; i++);
+		free_range(first, i-first);
+	}
+}
+
 /* 		
 * 	cm_bootstrap
 */
 
 void cm_bootstrap(void){
 	
-	spinlock_acquire(&cm_lock);
+	cm_lock_acquire();
 	lastpaddr = ram_getsize();
 	firstpaddr = ram_getfirstfree_(); 
 	ram_frames = (lastpaddr - firstpaddr)/PAGE_SIZE;
@@ -32,7 +466,7 @@ void cm_bootstrap(void){
 	
 	coremap = kmalloc(ram_frames*sizeof(cm_entry));
 	
-	spinlock_acquire(&cm_lock);
+	cm_lock_acquire();
 	unsigned int space = ram_frames*sizeof(cm_entry);
 	unsigned int i=0;
 	for( i =0; i < ram_frames ; i++){
@@ -41,6 +475,16 @@ void cm_bootstrap(void){
 		coremap[i].virt_addr = 0;
 		coremap[i].npages = 0; 
 		coremap[i].timestamp = -1; 
+		coremap[i].ref = 0;
+		coremap[i].list = 0;
+		coremap[i].as_next = -1;
+		coremap[i].as_prev = -1;
+		coremap[i].swap_slot = -1;
+#if OPT_IPT
+		coremap[i].ipt_as = NULL;
+		coremap[i].ipt_vaddr = 0;
+		coremap[i].ipt_next = -1;
+#endif
 	
 		if( i <= space/PAGE_SIZE ){
 			coremap[i].state = FIXED; 
@@ -51,15 +495,21 @@ void cm_bootstrap(void){
 		}
 	}
 
+	freelist_init();
+	policy = cm_policy_lookup(CM_POLICY_DEFAULT);
+	KASSERT(policy != NULL && policy->prepare == NULL);
 	bootstrapped = 1;
 	spinlock_release(&cm_lock);
+#if OPT_IPT
+	ipt_bootstrap();
+#endif
 }
 /* 		
 * 	cm_bootstrap_4test
 */
 void cm_bootstrap_4test(void){
 	
-	spinlock_acquire(&cm_lock);
+	cm_lock_acquire();
 	lastpaddr = ram_getsize();
 	firstpaddr = ram_getfirstfree_(); 
 	ram_frames = (lastpaddr - firstpaddr)/PAGE_SIZE;
@@ -68,7 +518,7 @@ void cm_bootstrap_4test(void){
 	
 	coremap = kmalloc(ram_frames*sizeof(cm_entry));
 	
-	spinlock_acquire(&cm_lock);
+	cm_lock_acquire();
 	unsigned int i=0;
 	/*
 	* Occupo tutta la coremap tranne gli ultimi 17 frame. Così i programmi saranno forzati a fare swapping.
@@ -79,6 +529,16 @@ void cm_bootstrap_4test(void){
 		coremap[i].virt_addr = 0;
 		coremap[i].npages = 0; 
 		coremap[i].timestamp = -1; 
+		coremap[i].ref = 0;
+		coremap[i].list = 0;
+		coremap[i].as_next = -1;
+		coremap[i].as_prev = -1;
+		coremap[i].swap_slot = -1;
+#if OPT_IPT
+		coremap[i].ipt_as = NULL;
+		coremap[i].ipt_vaddr = 0;
+		coremap[i].ipt_next = -1;
+#endif
 		coremap[i].state = FIXED; 
 		coremap[i].timestamp = timestamp++; 
 
@@ -89,17 +549,138 @@ void cm_bootstrap_4test(void){
 		coremap[i].state=FREE;
 	}
 	
+	freelist_init();
+	policy = cm_policy_lookup(CM_POLICY_DEFAULT);
+	KASSERT(policy != NULL && policy->prepare == NULL);
 	bootstrapped = 1;
 	spinlock_release(&cm_lock);
+#if OPT_IPT
+	ipt_bootstrap();
+#endif
+}
+/* 		
+* 	cm_print_fragmentation - statistiche del buddy allocator. Da chiamare con cm_lock acquisito.
+*/
+static void cm_print_fragmentation(void){
+	unsigned int i, largest = 0;
+
+	kprintf("free frames: %u/%u\n",free_frames,ram_frames);
+	for(i=0; i<=CM_MAX_ORDER; i++){
+		if(free_blocks[i] > 0){
+			kprintf("order %2u (%4u frames): %u free blocks\n", i, 1 << i, free_blocks[i]);
+			largest = 1 << i;
+		}
+	}
+	// frammentazione esterna: quota di memoria libera che non si trova nel blocco libero più grande
+	kprintf("largest free block: %u frames - fragmentation: %u%%\n", largest,
+		free_frames ? 100 - (largest*100)/free_frames : 0);
+	kprintf("frame_kalloc failures: %u\n", kalloc_fails);
+}
+/* 		
+* 	cm_print_stats
+*/
+void cm_print_stats(void){
+	unsigned int i, cached = 0;
+
+	cm_lock_acquire();
+	for(i=0; i<MAXCPUS; i++){
+		cached += cm_magazines[i].count;
+	}
+	kprintf("\nCoremap statistics:\n");
+	cm_print_fragmentation();
+	kprintf("frames cached in per-CPU magazines: %u\n", cached);
+	kprintf("frames in the zeroed pool: %u/%u\n", zero_count, CM_ZERO_POOL);
+	kprintf("cm_lock acquisitions: %u - contended: %u\n", cm_lock_acquired, cm_lock_contended);
+	spinlock_release(&cm_lock);
+	cm_policy_print_stats();
+}
+/* 		
+* 	cm_pageout_bootstrap
+*/
+void cm_pageout_bootstrap(void){
+	pageout_wchan = wchan_create("pageout");
+	if(pageout_wchan == NULL){
+		panic("Cannot create pageout wchan\n");
+	}
+}
+/* 		
+* 	cm_pageout_wait
+*/
+void cm_pageout_wait(void){
+	cm_lock_acquire();
+	while(cm_free_count() >= CM_FREE_LOW){
+		pageout_sleeping = 1;
+		wchan_sleep(pageout_wchan, &cm_lock);
+	}
+	pageout_sleeping = 0;
+	spinlock_release(&cm_lock);
+}
+/* 		
+* 	cm_pageout_needed - lettura senza cm_lock: un valore vecchio fa solo liberare un frame in più o in meno.
+*/
+int cm_pageout_needed(void){
+	return cm_free_count() < CM_FREE_HIGH;
+}
+/* 		
+* 	cm_zero_wait
+*/
+void cm_zero_wait(void){
+	cm_lock_acquire();
+	if(zero_wchan == NULL){
+		spinlock_release(&cm_lock);
+		zero_wchan = wchan_create("pagezero");	// wchan_create può allocare: fuori da cm_lock
+		if(zero_wchan == NULL){
+			panic("Cannot create pagezero wchan\n");
+		}
+		cm_lock_acquire();
+	}
+	// con pochi frame liberi il pool non viene riempito: si riprova al prossimo prelievo dal pool o alla prossima miss
+	while(zero_count >= CM_ZERO_POOL/2 || cm_free_count() < CM_FREE_HIGH){
+		zero_sleeping = 1;
+		wchan_sleep(zero_wchan, &cm_lock);
+	}
+	zero_sleeping = 0;
+	spinlock_release(&cm_lock);
+}
+/* 		
+* 	cm_zero_take
+*/
+paddr_t cm_zero_take(void){
+	int pos = -1;
+
+	cm_lock_acquire();
+	if(zero_count < CM_ZERO_POOL && cm_free_count() >= CM_FREE_HIGH){
+		pos = buddy_alloc(0);
+	}
+	spinlock_release(&cm_lock);
+	return (pos < 0)? 0 : firstpaddr+(pos*PAGE_SIZE);
+}
+/* 		
+* 	cm_zero_add
+*/
+void cm_zero_add(paddr_t paddr){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+
+	cm_lock_acquire();
+	KASSERT(zero_count < CM_ZERO_POOL && coremap[pos].state == FREE);
+	zero_pool[zero_count++] = pos;
+	spinlock_release(&cm_lock);
+}
+/* 		
+* 	cm_zero_pool_size
+*/
+unsigned int cm_zero_pool_size(void){
+	return zero_count;
 }
 /* 		
 * 	cm_print
 */
 void cm_print(const char* msg){
 	unsigned int i;
-	spinlock_acquire(&cm_lock);
+	cm_lock_acquire();
 
 	kprintf("\ncaller: %s\n",msg);
+	cm_print_fragmentation();
 	for(i=0; i<50; i++){
 		kprintf("[s: %d - t: %d]\n ",coremap[i].state,coremap[i].timestamp);
 	}
@@ -113,7 +694,7 @@ void cm_print(const char* msg){
 int is_bootstrapped(void){
 	int res;
 	
-	spinlock_acquire(&cm_lock);
+	cm_lock_acquire();
 	res = bootstrapped;
 	spinlock_release(&cm_lock);
 	return res;
@@ -123,176 +704,504 @@ int is_bootstrapped(void){
 */
 paddr_t frame_kalloc(unsigned int nframes){
 	
-	unsigned int first,i,found=0 ;
-	spinlock_acquire(&cm_lock);
-	
-		for(i=0;i<ram_frames && !found;i++){
-			if( coremap[i].state == FREE ){
-				if( (i==0) || (coremap[i-1].state != FREE) ){
-					first = i;
-				}
-				if( i - first +1 >= nframes ){ //c'è lo spazio necessario
-					found = 1 ; 
-				}
-			}
+	unsigned int order, i, t;
+	int first;
+
+	if(nframes == 1){				// caso più frequente (pagine di kmalloc): nessun lock condiviso
+		first = mag_get();
+		if(first < 0){
+			return 0;
 		}
+		coremap[first].state = FIXED;
+		coremap[first].as = NULL;
+		coremap[first].virt_addr = PADDR_TO_KVADDR(firstpaddr+(first*PAGE_SIZE)); 
+		coremap[first].timestamp = cm_stamp(); 
+		coremap[first].npages = 1;
+		return firstpaddr+(first*PAGE_SIZE);
+	}
+
+	order = buddy_order(nframes);
+	if(order > CM_MAX_ORDER){
+		return 0;
+	}
+
+	cm_lock_acquire();
 	
-		if(found){
-			for(i=first;i<nframes+first ;i++){
-				if(i == first){
-					coremap[i].npages = nframes;
-				}
-				coremap[i].state = FIXED;
-				coremap[i].as = NULL;
-				coremap[i].virt_addr = PADDR_TO_KVADDR(firstpaddr+(i*PAGE_SIZE)); 
-				coremap[i].timestamp = timestamp; 
-			}
-			timestamp++;
-				
-			spinlock_release(&cm_lock);
-			return firstpaddr+(first*PAGE_SIZE);			
-		}
+	first = buddy_alloc(order);
+	if(first < 0){
+		spinlock_release(&cm_lock);
+		mag_drain();				// i frame delle magazine possono completare i blocchi mancanti
+		cm_lock_acquire();
+		first = buddy_alloc(order);
+	}
+	if(first < 0){
+		kalloc_fails++;
+		spinlock_release(&cm_lock);
+		return 0;
+	}
 	
+	// i frame in eccesso rispetto alla richiesta tornano subito al buddy allocator
+	free_range(first+nframes, (1 << order) - nframes);
+
+	t = cm_stamp();
+	for(i=first;i<nframes+first ;i++){
+		coremap[i].npages = 0;
+		coremap[i].state = FIXED;
+		coremap[i].as = NULL;
+		coremap[i].virt_addr = PADDR_TO_KVADDR(firstpaddr+(i*PAGE_SIZE)); 
+		coremap[i].timestamp = t; 
+	}
+	coremap[first].npages = nframes;
+	pageout_check();
+		
 	spinlock_release(&cm_lock);
-	return 0;
+	return firstpaddr+(first*PAGE_SIZE);			
 }
 /* 		
 * 	frame_alloc
 */
-paddr_t frame_alloc(vaddr_t vaddr, struct addrspace* as){
+paddr_t frame_alloc(vaddr_t vaddr, struct addrspace* as, int zero){
 	
-	unsigned int i;
-	spinlock_acquire(&cm_lock);
+	int i = -1;
 	
-	for(i=0;i<ram_frames ;i++){
-			    if( coremap[i].state == FREE ){
-					coremap[i].state = LOADING;  // il caricamento è iniziato, quando finirà lo stato del frame verrà aggiornato in CLEAN
-					coremap[i].npages = 1;
-					coremap[i].as = as;
-					coremap[i].virt_addr = vaddr;
-					coremap[i].timestamp = timestamp++; 
-					spinlock_release(&cm_lock);
-					return firstpaddr+(i*PAGE_SIZE);
-			    }
+	if(zero){
+		i = zero_pool_get();
+	}
+	if(i >= 0){
+		vmstats_inc(ZERO_POOL_HIT);
+	}
+	else{
+		i = mag_get();				// frame dalla magazine della CPU, senza acquisire cm_lock
+		if(i < 0 && !zero){
+			i = zero_pool_get();		// memoria esaurita: anche i frame del pool sono liberi
+		}
+		if(i < 0){
+			return 0;
+		}
+		if(zero){
+			vmstats_inc(ZERO_POOL_MISS);
+			if(zero_sleeping){		// il pool è vuoto: il thread pagezero può riprovare a riempirlo
+				cm_lock_acquire();
+				zero_check();
+				spinlock_release(&cm_lock);
 			}
-	spinlock_release(&cm_lock);
-	return 0;		
+			bzero((void *)PADDR_TO_KVADDR(firstpaddr+(i*PAGE_SIZE)), PAGE_SIZE);
+		}
+	}
+	KASSERT(coremap[i].state == FREE);
+
+	/*
+	* Il frame appartiene al chiamante, quindi può essere inizializzato senza cm_lock. Lo stato viene scritto per primo:
+	* cm_evict ignora i frame LOADING e non può scegliere il frame mentre as e virt_addr vengono aggiornati.
+	*/
+	coremap[i].state = LOADING;  // il caricamento è iniziato, quando finirà lo stato del frame verrà aggiornato in CLEAN o DIRTY
+	membar_store_store();
+	coremap[i].npages = 1;
+	coremap[i].as = as;
+	coremap[i].virt_addr = vaddr;
+	coremap[i].timestamp = cm_stamp(); 
+	coremap[i].ref_time = coremap[i].timestamp;
+	coremap[i].ref = 1;
+	coremap[i].swap_slot = -1;
+	if(as != NULL){
+		rmap_insert(as, i);
+#if OPT_IPT
+		ipt_insert(i);
+#endif
+	}
+	return firstpaddr+(i*PAGE_SIZE);
 }
 /* 		
 * 	frame_kfree 
 */
 int frame_kfree(vaddr_t vaddr){
 
-	unsigned int pos,j, npages;
+	unsigned int pos, npages;
 	paddr_t paddr = vaddr - MIPS_KSEG0;
 
-	spinlock_acquire(&cm_lock);
-	if(!bootstrapped){
-		spinlock_release(&cm_lock);
+	if(!bootstrapped){				// scritto una sola volta al boot: non serve cm_lock
 		return 0;
 	}
 	
+	// il blocco appartiene al chiamante: npages non cambia finché non viene liberato, e una pagina singola
+	// torna nella magazine della CPU senza passare da cm_lock
 	pos = (paddr - firstpaddr)/PAGE_SIZE;
 	npages = coremap[pos].npages;
 
-	for (j=pos; j< pos+npages; j++){
-		coremap[j].state = FREE;
-		coremap[j].npages = 0;
-		coremap[j].virt_addr = 0; 
-		coremap[j].timestamp = -1;
+	if(npages == 1){
+		KASSERT(coremap[pos].state == FIXED);
+		mag_put(pos);
+		return 1;
+	}
+	cm_lock_acquire();
+	if(npages > 0){
+		KASSERT(coremap[pos].state == FIXED);
+		free_range(pos, npages);		// i blocchi vengono fusi con i buddy liberi
 	}
 	spinlock_release(&cm_lock);
 	return 1;
 }
 /* 		
+* 	frame_free
+*/
+void frame_free(paddr_t paddr){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+
+	cm_lock_acquire();
+	KASSERT(coremap[pos].state == LOADING && coremap[pos].as == NULL);
+#if OPT_IPT
+	KASSERT(coremap[pos].ipt_as == NULL);		// cm_unmap è già stata chiamata
+#endif
+	free_range(pos, 1);				// nel buddy e non in una magazine: il frame serve a tutte le CPU
+	spinlock_release(&cm_lock);
+}
+/* 		
 * 	cm_asfree
 */
 void cm_asfree( struct addrspace* as){
-	unsigned int i;
-	spinlock_acquire(&cm_lock);
-	for(i=0;i<ram_frames;i++){
-		if((coremap[i].as == as) && ( coremap[i].state!=FIXED )){
-			coremap[i].as = NULL;
-			coremap[i].state = FREE;
-			coremap[i].npages = 0;
-			coremap[i].virt_addr = 0; 
-			coremap[i].timestamp = -1;	
+	int i, next;
+	cm_lock_acquire();
+	// se un'altra CPU sta facendo swap out di una pagina di as, bisogna aspettare che abbia aggiornato la pt di as
+	while(as->evicting > 0){
+		spinlock_release(&cm_lock);
+		thread_yield();
+		cm_lock_acquire();
+	}
+	// nessun altro processo può più aggiungere o togliere frame di as: la lista si scorre senza frames_lock
+	for(i=as->frames; i>=0; i=next){
+		next = coremap[i].as_next;
+		KASSERT(coremap[i].as == as && coremap[i].state != FIXED);
+		if(policy->unmap != NULL){
+			policy->unmap(i);
 		}
+		coremap[i].as_next = -1;
+		coremap[i].as_prev = -1;
+		coremap[i].swap_slot = -1;
+#if OPT_IPT
+		ipt_remove(i);
+#endif
+		free_range(i, 1);
+	}
+	as->frames = -1;
+	if(policy->asfree != NULL){
+		policy->asfree(as);
 	}
+	as->resident = 0;
 	spinlock_release(&cm_lock);
 }
 /* 		
+* 	cm_set_repl_mode
+*/
+void cm_set_repl_mode(int mode){
+	KASSERT(mode == CM_REPL_LOCAL || mode == CM_REPL_GLOBAL);
+	repl_mode = mode;
+}
+/* 		
+* 	cm_get_repl_mode
+*/
+int cm_get_repl_mode(void){
+	return repl_mode;
+}
+/* 		
+* 	cm_set_policy
+*/
+int cm_set_policy(const char* name){
+	struct cm_policy* p;
+	int result;
+
+	p = cm_policy_lookup(name);
+	if(p == NULL){
+		return ENOENT;
+	}
+	if(p->prepare != NULL){				// può allocare memoria: va chiamata senza cm_lock
+		result = p->prepare();
+		if(result){
+			return result;
+		}
+	}
+	cm_lock_acquire();
+	if(p != policy){
+		policy = p;
+		if(policy->start != NULL){
+			policy->start();
+		}
+	}
+	spinlock_release(&cm_lock);
+	return 0;
+}
+/* 		
+* 	cm_policy_name
+*/
+const char* cm_policy_name(void){
+	return (policy != NULL)? policy->name : CM_POLICY_DEFAULT;
+}
+/* 		
+* 	cm_policy_stat - oltre al totale in vm_stats incrementa il contatore della politica attiva. policy viene letto
+*		senza cm_lock: un evento a cavallo di cm_set_policy può essere attribuito alla politica precedente.
+*/
+void cm_policy_stat(unsigned int pos){
+	struct cm_policy* p = policy;
+
+	KASSERT(pos >= REPL_HIT && pos < REPL_HIT + CM_POLICY_STATS);
+	vmstats_inc(pos);
+	if(p == NULL){
+		return;
+	}
+	spinlock_acquire(&policy_stats_lock);
+	p->stats[pos - REPL_HIT]++;
+	spinlock_release(&policy_stats_lock);
+}
+/* 		
+* 	cm_touch - la pagina nel frame è stata riferita. Il bit viene solo alzato, non serve cm_lock.
+*/
+void cm_touch(paddr_t paddr){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+	coremap[pos].ref = 1;
+}
+/* 		
+* 	cm_clear_ref - chiamata da interrupt: la pagina può non essere più nella coremap (frame del kernel o fuori range).
+*/
+void cm_clear_ref(paddr_t paddr){
+	unsigned int pos;
+
+	if(!bootstrapped || paddr < firstpaddr || paddr >= lastpaddr){
+		return;
+	}
+	pos = (paddr-firstpaddr)/PAGE_SIZE;
+	coremap[pos].ref = 0;
+}
+/* 		
+* 	cm_nframes
+*/
+unsigned int cm_nframes(void){
+	return ram_frames;
+}
+/* 		
+* 	cm_now
+*/
+unsigned int cm_now(void){
+	return timestamp;
+}
+/* 		
+* 	cm_is_candidate
+*/
+int cm_is_candidate(unsigned int pos, struct addrspace* as){
+	struct addrspace* owner = coremap[pos].as;
+
+	if((coremap[pos].state != CLEAN && coremap[pos].state != DIRTY) || owner == NULL){
+		return 0;
+	}
+	if(evict_any){					// ultimo tentativo di cm_evict: politica locale e riserve ignorate
+		return 1;
+	}
+	// resident è letto senza frames_lock: una stima superata di un frame non compromette la riserva
+	if(as == NULL){					// pageout daemon: qualsiasi processo, purché mantenga la sua riserva
+		return owner->resident > CM_MIN_RESIDENT;
+	}
+	// con politica globale si possono scegliere frame di altri processi, purché mantengano la loro riserva
+	return (owner == as || (repl_mode == CM_REPL_GLOBAL && owner->resident > CM_MIN_RESIDENT))? 1 : 0;
+}
+/* 		
 * 	cm_evict
 */
-vaddr_t cm_evict(struct addrspace* as, paddr_t* paddr, int* pos){
-	unsigned int min, min_pos, i;
+vaddr_t cm_evict(struct addrspace* as, struct addrspace** owner, paddr_t* paddr, int* pos, int* dirty, int* slot){
+	int victim_pos;
 	vaddr_t victim;
+	struct addrspace* victim_as;
 	
-	spinlock_acquire(&cm_lock);
-	min = timestamp;
-	min_pos = -1;
-	
-	// trovo il frame che si trova in memoria da più tempo
-	for(i=0; i<ram_frames; i++){
-		if((coremap[i].as == as) && ( coremap[i].state!=FIXED ) && ( coremap[i].state!=LOADING ) && (coremap[i].timestamp < min)){
-			min = coremap[i].timestamp;
-			min_pos = i;
-		}
+	cm_lock_acquire();
+	victim_pos = policy->select(as);			// la politica attiva sceglie tra i frame per cui cm_is_candidate vale 1
+	if(victim_pos<0 && as != NULL){
+		/*
+		* Page fault: tutti i frame sono protetti dalla politica locale o dalle riserve CM_MIN_RESIDENT.
+		* Piuttosto che fallire si sceglie tra tutti i frame utente in memoria.
+		*/
+		evict_any = 1;
+		victim_pos = policy->select(as);
+		evict_any = 0;
 	}
-	if((int)min_pos<0){
-		panic("Cannot find victim!\n");
+	if(victim_pos<0){				// nessun frame può essere liberato (sono tutti LOADING o di kernel)
+		spinlock_release(&cm_lock);
+		*owner = NULL;
+		*slot = -1;
+		return 0;
 	}
-	victim = coremap[min_pos].virt_addr;
-	*paddr = firstpaddr+(min_pos*PAGE_SIZE);
-	*pos = min_pos;
+	victim = coremap[victim_pos].virt_addr;
+	victim_as = coremap[victim_pos].as;
+	*owner = victim_as;
+	*paddr = firstpaddr+(victim_pos*PAGE_SIZE);
+	*pos = victim_pos;
+	*dirty = (coremap[victim_pos].state == DIRTY);	// dopo il cambio di stato in LOADING cm_set_dirty fallisce: il valore è definitivo
+	*slot = coremap[victim_pos].swap_slot;
+	KASSERT(!*dirty || *slot < 0);			// cm_set_dirty toglie lo slot
+	
+	victim_as->evicting++;
+	rmap_remove(victim_as, victim_pos);				// as_destroy del proprietario aspetta la fine dello swap out
 	
-	coremap[min_pos].as = NULL;
-	coremap[min_pos].state = LOADING;
-	coremap[min_pos].npages = 0;
-	coremap[min_pos].virt_addr = 0; 
-	coremap[min_pos].timestamp = -1;
+	coremap[victim_pos].as = NULL;
+	coremap[victim_pos].state = LOADING;
+	coremap[victim_pos].npages = 0;
+	coremap[victim_pos].virt_addr = 0; 
+	coremap[victim_pos].timestamp = -1;
+	coremap[victim_pos].swap_slot = -1;
 	
 	spinlock_release(&cm_lock);
 
 	return victim;
 }
 /* 		
+* 	cm_evict_done - da chiamare dopo aver aggiornato la pt del proprietario della vittima.
+*/
+void cm_evict_done(struct addrspace* owner){
+	cm_lock_acquire();
+	KASSERT(owner->evicting > 0);
+	owner->evicting--;
+	spinlock_release(&cm_lock);
+}
+/* 		
+* 	cm_check_owner - controlla che il frame sia ancora associato alla pagina vaddr di as. Se non lo è la pagina
+*			 è in fase di swap out da parte di un altro processo.
+*/
+int cm_check_owner(paddr_t paddr, struct addrspace* as, vaddr_t vaddr){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+	return (coremap[pos].as == as && coremap[pos].virt_addr == vaddr)? 1 : 0;
+}
+/* 		
+* 	cm_set_dirty - prima scrittura su una pagina CLEAN. Serve cm_lock: cm_evict potrebbe scegliere il frame nello stesso momento.
+*		       Anche PTE_DIRTY va scritto con cm_lock: dopo il rilascio il frame può essere scelto come vittima e
+*		       pt_evicting riscrive la entry, che una modifica successiva sovrascriverebbe.
+*/
+int cm_set_dirty(paddr_t paddr, struct addrspace* as, vaddr_t vaddr, pt_entry* pte, int* slot){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+	int res = 0;
+
+	*slot = -1;
+	cm_lock_acquire();
+	if(coremap[pos].as == as && coremap[pos].virt_addr == vaddr && coremap[pos].state != LOADING){
+		coremap[pos].state = DIRTY;
+		*pte |= PTE_DIRTY;
+		*slot = coremap[pos].swap_slot;		// la copia nello swapfile non è più aggiornata
+		coremap[pos].swap_slot = -1;
+		res = 1;
+	}
+	spinlock_release(&cm_lock);
+	return res;
+}
+/* 		
+* 	cm_set_slot - il frame è LOADING e appartiene al chiamante: non serve cm_lock.
+*/
+void cm_set_slot(paddr_t paddr, int slot){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+
+	KASSERT(coremap[pos].state == LOADING);
+	coremap[pos].swap_slot = slot;
+}
+/* 		
+* 	cm_reclaim_slot - swapfile pieno: toglie dalla swap cache lo slot di un frame CLEAN in memoria e lo libera. Il frame
+*			  diventa DIRTY perché non ha più una copia nello swapfile. Lo slot viene liberato con cm_lock acquisito
+*			  (ordine: cm_lock, poi sw_lock), così il proprietario non può essere distrutto nel frattempo.
+*/
+int cm_reclaim_slot(void){
+	unsigned int i, pos;
+	int found = 0;
+
+	cm_lock_acquire();
+	for(i=0; i<ram_frames && !found; i++){
+		pos = (reclaim_hand + i) % ram_frames;
+		if(coremap[pos].state == CLEAN && coremap[pos].as != NULL && coremap[pos].swap_slot >= 0){
+			swap_drop(coremap[pos].as, coremap[pos].swap_slot);
+			coremap[pos].swap_slot = -1;
+			coremap[pos].state = DIRTY;
+			reclaim_hand = (pos+1) % ram_frames;
+			found = 1;
+		}
+	}
+	spinlock_release(&cm_lock);
+	return found;
+}
+/* 		
 * 	cm_update_vaddr
 */
 void cm_update_vaddr(struct addrspace* as, int pos, vaddr_t vaddr){
 	KASSERT(pos >=0 && pos<(int)ram_frames);
 	
-	spinlock_acquire(&cm_lock);
-	coremap[pos].state = LOADING; 
+	// il frame è stato restituito da cm_evict in stato LOADING: appartiene al chiamante e non serve cm_lock
+	KASSERT(coremap[pos].state == LOADING);
 	coremap[pos].as = as;
 	coremap[pos].virt_addr = vaddr;
-	coremap[pos].timestamp = timestamp++;
+	coremap[pos].timestamp = cm_stamp();
+	coremap[pos].ref_time = coremap[pos].timestamp;
+	coremap[pos].ref = 1;
 	coremap[pos].npages = 1;
-	spinlock_release(&cm_lock);
+	coremap[pos].swap_slot = -1;
+	rmap_insert(as, pos);
+#if OPT_IPT
+	ipt_insert(pos);
+#endif
 }
 /* 		
 * 	cm_check_state
 */
 int cm_check_state(paddr_t paddr,frame_state state){
 	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
-	int res;
-	spinlock_acquire(&cm_lock);
-	res = (coremap[pos].state == state)? 1 : 0;
-	spinlock_release(&cm_lock);
-	return res;
+	// la lettura di una parola allineata è atomica: non serve cm_lock
+	return (coremap[pos].state == state)? 1 : 0;
 }
 /* 		
 * 	cm_update_state
 */
 void cm_update_state(paddr_t paddr, frame_state state){
 	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
-	spinlock_acquire(&cm_lock);
+	
+	if((state == CLEAN || state == DIRTY) && policy->map != NULL){
+		// la politica tiene liste dei frame in memoria: il frame va inserito insieme al cambio di stato
+		cm_lock_acquire();
+		coremap[pos].state = state;
+		policy->map(pos);
+		spinlock_release(&cm_lock);
+		return;
+	}
+	// solo il possessore del frame (in stato LOADING) ne cambia lo stato: la scrittura di una parola è atomica
 	coremap[pos].state = state;
-	spinlock_release(&cm_lock);
 }
+#if OPT_IPT
+/* 		
+* 	cm_lookup - il frame trovato può essere in fase di swap out (as azzerato da cm_evict): il chiamante lo scopre con
+*		    cm_check_owner, come per una entry della page table.
+*/
+paddr_t cm_lookup(struct addrspace* as, vaddr_t vaddr, int* dirty){
+	int pos;
+
+	spinlock_acquire(&ipt_lock);
+	for(pos=ipt_hash[IPT_HASH(as, vaddr, ipt_mask)]; pos>=0; pos=coremap[pos].ipt_next){
+		if(coremap[pos].ipt_as == as && coremap[pos].ipt_vaddr == vaddr){
+			break;
+		}
+	}
+	spinlock_release(&ipt_lock);
+	if(pos < 0){
+		return 0;
+	}
+	*dirty = (coremap[pos].state == DIRTY);
+	return firstpaddr+(pos*PAGE_SIZE);
+}
+/* 		
+* 	cm_unmap
+*/
+void cm_unmap(paddr_t paddr){
+	unsigned int pos = (paddr-firstpaddr)/PAGE_SIZE;
+
+	KASSERT(coremap[pos].state == LOADING && coremap[pos].ipt_as != NULL);
+	ipt_remove(pos);
+}
+#endif
 /* 		
 * 	cm_shutdown
 */
 void cm_shutdown(void){
+	cm_policy_shutdown();
+#if OPT_IPT
+	kfree(ipt_hash);
+#endif
 	kfree(coremap);
 }
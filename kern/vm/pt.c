@@ -1,44 +1,131 @@
 #include "pt.h"
+#include <kern/errno.h>
 
-pt_entry* pt_create(vaddr_t vaddr){
+pagetable* utlb_pgdir[MAXCPUS];
 
-	pt_entry* pte = kmalloc(sizeof(pt_entry));
-	pte->page = vaddr;
-	pte->frame = 0;
-	pte->in_mem = 0;	
-	pte->in_swap = 0;
-	pte->next=NULL;
-	return pte;
+pagetable* pt_create(void){
+
+	pagetable* pt;
+	
+	pt = kmalloc(sizeof(pagetable));
+	if(pt == NULL){
+		return NULL;
+	}
+	bzero(pt, sizeof(pagetable));
+	return pt;
+
+}
+/*
+*	leaf_alloc - alloca la foglia d della directory, con tutte le entry azzerate.
+*/
+static int leaf_alloc(pagetable* pt, unsigned int d){
+	pt->dir[d] = kmalloc(PT_LEAF_ENTRIES*sizeof(pt_entry));
+	if(pt->dir[d] == NULL){
+		return ENOMEM;
+	}
+	bzero(pt->dir[d], PT_LEAF_ENTRIES*sizeof(pt_entry));
+	return 0;
+}
+int pt_alloc_range(pagetable* pt, vaddr_t vaddr, int npages, int write){
+
+	unsigned int d, first, last;
+	int i;
+	
+	KASSERT(npages > 0);
+	first = PT_DIR_INDEX(vaddr);
+	last = PT_DIR_INDEX(vaddr + (npages-1)*PAGE_SIZE);
+	KASSERT(last < PT_DIR_ENTRIES);
+	for(d=first; d<=last; d++){
+		if(pt->dir[d] != NULL){			// foglia condivisa con un altro segmento
+			continue;
+		}
+		if(leaf_alloc(pt, d)){
+			return ENOMEM;			// le foglie già allocate verranno liberate da pt_free
+		}
+	}
+	if(write){
+		for(i=0; i<npages; i++){
+			*pt_lookup(pt, vaddr + i*PAGE_SIZE) |= PTE_WRITE;
+		}
+	}
+	return 0;
 
 }
-void pt_free(pt_entry* pt){
-	pt_entry* p;
+pt_entry* pt_lookup(pagetable* pt, vaddr_t vaddr){
+
+	pt_entry* leaf;
 	
-	while(pt!=NULL){
-		p = pt;
-		pt = (pt_entry*)p->next;
-		kfree(p);
+	if(PT_DIR_INDEX(vaddr) >= PT_DIR_ENTRIES){
+		return NULL;
+	}
+	leaf = pt->dir[PT_DIR_INDEX(vaddr)];
+	if(leaf == NULL){
+		return NULL;
 	}
+	return &leaf[PT_LEAF_INDEX(vaddr)];
+
+}
+pt_entry* pt_get(pagetable* pt, vaddr_t vaddr){
+
+	KASSERT(PT_DIR_INDEX(vaddr) < PT_DIR_ENTRIES);
+	if(pt->dir[PT_DIR_INDEX(vaddr)] == NULL && leaf_alloc(pt, PT_DIR_INDEX(vaddr))){
+		return NULL;
+	}
+	return &pt->dir[PT_DIR_INDEX(vaddr)][PT_LEAF_INDEX(vaddr)];
+
 }
-void pt_update(pt_entry* pt, vaddr_t vaddr){
-	pt_entry* tmp = pt;
+void pt_free(pagetable* pt){
+
+	unsigned int d;
 	
-	while(tmp != NULL){
-		if(tmp->page == vaddr){
-			tmp->in_mem = 0;
-			tmp->in_swap = 1;
-			tmp->frame = 0;
-			break;
+	if(pt == NULL){
+		return;
+	}
+	for(d=0; d<PT_DIR_ENTRIES; d++){
+		if(pt->dir[d] != NULL){
+			kfree(pt->dir[d]);
 		}
-		tmp = (pt_entry*) tmp->next;
+	}
+	kfree(pt);
+}
+void pt_evicting(pagetable* pt, vaddr_t vaddr){
+	pt_entry* pte = pt_lookup(pt, vaddr);
+	
+	KASSERT(pte != NULL && PTE_IN_MEM(*pte));
+	*pte = (*pte & (PTE_FRAME | PTE_WRITE)) | PTE_EVICTING;
+}
+void pt_update(pagetable* pt, vaddr_t vaddr, int slot){
+	pt_entry* pte = pt_lookup(pt, vaddr);
+	
+	KASSERT(pte != NULL);
+	if(slot >= 0){
+		*pte = PTE_SWAP(*pte, slot);
+	}
+	else{
+		*pte = *pte & PTE_WRITE;		// senza PTE_SWAPPED la pagina verrà riletta dall'elf o azzerata
 	}
 }
-void pt_print_state(pt_entry* pte){
-	pt_entry* pt = pte;	
+void pt_print_state(pagetable* pt){
+	unsigned int d, l;
+	pt_entry pte;
+	
 	kprintf("Printing PageTable\n");
-	while(pt!= NULL){
-		kprintf("vaddr 0x%x - paddr 0x%x - inmem %d inswap %d \n",pt->page,pt->frame,pt->in_mem,pt->in_swap);
-		pt = (pt_entry*) pt->next;
+	for(d=0; d<PT_DIR_ENTRIES; d++){
+		if(pt->dir[d] == NULL){
+			continue;
+		}
+		for(l=0; l<PT_LEAF_ENTRIES; l++){
+			pte = pt->dir[d][l];
+			if(!PTE_IN_MEM(pte) && !PTE_IN_SWAP(pte)){
+				continue;
+			}
+			if(PTE_IN_SWAP(pte)){
+				kprintf("vaddr 0x%x - slot %d\n",(d << PT_DIR_SHIFT)|(l << 12),PTE_SLOT(pte));
+				continue;
+			}
+			kprintf("vaddr 0x%x - paddr 0x%x - dirty %d\n",(d << PT_DIR_SHIFT)|(l << 12),PTE_PADDR(pte),
+				(pte & PTE_DIRTY) != 0);
+		}
 	}
 	kprintf("\n");
 
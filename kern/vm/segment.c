@@ -1,31 +1,99 @@
 #include "segment.h"
+#include <kern/errno.h>
 
-segment_entry* sgm_create(vaddr_t vaddr,off_t offset, int sz,size_t segsz,int r,int w ,int x, segment_entry* next){
+segment_entry* sgm_create(vaddr_t vaddr,off_t offset, int sz,size_t segsz,size_t filesz,int r,int w ,int x){
 	
 	segment_entry* sgm = kmalloc(sizeof(segment_entry));
+	if(sgm == NULL){
+		return NULL;
+	}
 
 	sgm->first_addr=vaddr;
 	sgm->npages=sz;
 	sgm->size = segsz;
+	sgm->filesz = filesz;
 	sgm->offset=offset;	
 	sgm->permission = kmalloc(sizeof(permissions));
+	if(sgm->permission == NULL){
+		kfree(sgm);
+		return NULL;
+	}
 	sgm->permission->read = r;
 	sgm->permission->write = w;
 	sgm->permission->exec = x;
-	sgm->first_pt_entry=NULL;	
-	sgm->next= (struct segment_entry*)next;
 	return sgm;
 
 }
 
-void sgm_free(segment_entry* sge){
-	segment_entry* s;
+void sgm_init(segment_table* st){
+	st->seg = NULL;
+	st->count = 0;
+	st->size = 0;
+	st->last = NULL;
+}
+
+int sgm_insert(segment_table* st, segment_entry* sgm){
+	segment_entry** v;
+	int i;
+	
+	if(st->count == st->size){			// vettore pieno: raddoppia
+		v = kmalloc((st->size ? 2*st->size : SGM_TABLE_INIT)*sizeof(segment_entry*));
+		if(v == NULL){
+			return ENOMEM;
+		}
+		for(i=0; i<st->count; i++){
+			v[i] = st->seg[i];
+		}
+		if(st->seg != NULL){
+			kfree(st->seg);
+		}
+		st->seg = v;
+		st->size = st->size ? 2*st->size : SGM_TABLE_INIT;
+	}
+	// inserimento ordinato: i segmenti sono pochi e vengono creati solo al caricamento del programma
+	for(i=st->count; i>0 && st->seg[i-1]->first_addr > sgm->first_addr; i--){
+		st->seg[i] = st->seg[i-1];
+	}
+	st->seg[i] = sgm;
+	st->count++;
+	return 0;
+}
+
+segment_entry* sgm_lookup(segment_table* st, vaddr_t vaddr){
+	segment_entry* s = st->last;
+	int lo, hi, mid;
 	
-	while(sge!=NULL){
-		s = sge;
-		kfree(sge->permission);
-		sge = (segment_entry*)s->next;
-		kfree(s);
+	if(s != NULL && vaddr >= s->first_addr && vaddr < s->first_addr+(s->npages*PAGE_SIZE)){
+		return s;
 	}
+	lo = 0;
+	hi = st->count-1;
+	while(lo <= hi){
+		mid = (lo+hi)/2;
+		s = st->seg[mid];
+		if(vaddr < s->first_addr){
+			hi = mid-1;
+		}
+		else if(vaddr >= s->first_addr+(s->npages*PAGE_SIZE)){
+			lo = mid+1;
+		}
+		else{
+			st->last = s;
+			return s;
+		}
+	}
+	return NULL;
 }
 
+void sgm_free(segment_table* st){
+	int i;
+	
+	for(i=0; i<st->count; i++){
+		kfree(st->seg[i]->permission);
+		kfree(st->seg[i]);
+	}
+	if(st->seg != NULL){
+		kfree(st->seg);
+	}
+	sgm_init(st);
+}
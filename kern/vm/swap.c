@@ -1,9 +1,112 @@
 #include "swap.h"
+#include "coremap.h"
+#include "vm_stats.h"
+#include <kern/stat.h>
+#include <device.h>
+#if OPT_ZSWAP
+#include <synch.h>
+#include <thread.h>
+#include "zswap.h"
+#endif
 
 static struct spinlock sw_lock = SPINLOCK_INITIALIZER;
 static struct swap_entry* swapspace;
 static struct vnode* swapfile;
+static struct device* swapdev;		// disco raw su cui si trova lo swap (swap_setdevice), NULL se si usa lo swapfile
+static char swapdevname[SWAP_DEVNAME_LEN];
 static const char swapfilename[] = "emu0:swapfile";
+static uint32_t swap_map[SWAP_WORDS];	// bit a 1: slot occupato (o oltre la fine dello swap), protetta da sw_lock
+static unsigned int swap_cursor;	// slot successivo all'ultimo assegnato: da qui parte la prossima ricerca
+static unsigned int swap_used;		// slot occupati
+#if OPT_ZSWAP
+static int zs_head = -1;		// slot entrato nel pool da più tempo (-1 se il pool è vuoto), protetto da sw_lock
+static int zs_tail = -1;
+static unsigned int zs_bytes;		// byte compressi nel pool
+static struct lock* zs_wb_lock;		// serializza le scritture delle pagine uscite dal pool: usano tutte zs_page
+static paddr_t zs_page;			// frame in cui viene decompressa la pagina da scrivere nello swapfile
+#endif
+#if OPT_IPT
+static int swap_hash[SWAP_HASH_SIZE];	// teste delle catene (as, vaddr) -> slot, protette da sw_lock
+
+/* 		
+* 	slot_hash_find - cerca lo slot della pagina vaddr di as. Restituisce -1 se non c'è. Da chiamare con sw_lock acquisito.
+*/
+static int slot_hash_find(struct addrspace* as, vaddr_t vaddr){
+	int i;
+
+	for(i=swap_hash[IPT_HASH(as, vaddr, SWAP_HASH_SIZE-1)]; i>=0; i=swapspace[i].hash_next){
+		if(swapspace[i].as == as && swapspace[i].vaddr == vaddr){
+			break;
+		}
+	}
+	return i;
+}
+#endif
+/* 		
+* 	swap_map_init - nslots slot liberi, gli altri occupati. Da chiamare con sw_lock acquisito e swap vuoto.
+*/
+static void swap_map_init(int nslots){
+	int i;
+
+	for (i=0; i<SWAP_WORDS; i++){
+		swap_map[i] = 0;
+	}
+	for (i=nslots; i<SWAP_WORDS*32; i++){
+		swap_map[i/32] |= 1U << (i%32);
+	}
+	swap_cursor = 0;
+}
+/* 		
+* 	swap_io - trasferisce n pagine tra i frame paddrs e gli slot consecutivi a partire da slot, con una sola richiesta
+*		  (un iovec per frame). Su un disco raw la richiesta va direttamente al driver (lhd_io), come una lettura o
+*		  scrittura di 8 settori per pagina, senza passare da vfs ed emufs.
+*/
+static int swap_io(int slot, paddr_t* paddrs, int n, enum uio_rw rw){
+	struct iovec iov[SWAP_CLUSTER];
+	struct uio u;
+	int i;
+
+	KASSERT(n > 0 && n <= SWAP_CLUSTER);
+	// il trasferimento avviene tramite l'indirizzo kernel dei frame: non dipende dalla tlb né dall'as corrente
+	for(i=0; i<n; i++){
+		iov[i].iov_kbase = (void *)PADDR_TO_KVADDR(paddrs[i]);
+		iov[i].iov_len = PAGE_SIZE;
+	}
+	u.uio_iov = iov;
+	u.uio_iovcnt = n;
+	u.uio_offset = (off_t)slot*PAGE_SIZE;
+	u.uio_resid = n*PAGE_SIZE;
+	u.uio_segflg = UIO_SYSSPACE;
+	u.uio_rw = rw;
+	u.uio_space = NULL;
+	if(swapdev != NULL){
+		return DEVOP_IO(swapdev, &u);
+	}
+	return (rw == UIO_READ)? VOP_READ(swapfile, &u) : VOP_WRITE(swapfile, &u);
+}
+/* 		
+* 	swap_io_runs - come swap_io, ma trasferisce solo le pagine con skip[i] a 0, a sequenze di slot consecutivi: le
+*		       altre sono già state lette o scritte nel pool compresso.
+*/
+static int swap_io_runs(int slot, paddr_t* paddrs, const char* skip, int n, enum uio_rw rw){
+	int i, j, result;
+
+	for(i=0; i<n; i=j){
+		j = i+1;
+		if(skip[i]){
+			continue;
+		}
+		for(; j<n && !skip[j]; j++);
+		result = swap_io(slot+i, paddrs+i, j-i, rw);
+		if(result){
+			return result;
+		}
+		if(rw == UIO_WRITE && j-i > 1){
+			vmstats_inc(SWAP_CLUSTER_WRITE);
+		}
+	}
+	return 0;
+}
 /* 		
 * 	swapspace_bootstrap 
 */
@@ -21,7 +124,25 @@ void swapspace_bootstrap(void){
 	for (i=0; i<SWAP_SIZE; i++){
 		swapspace[i].as = NULL;
 		swapspace[i].vaddr = 0;
+		swapspace[i].next = -1;
+		swapspace[i].prev = -1;
+#if OPT_IPT
+		swapspace[i].hash_next = -1;
+#endif
+#if OPT_ZSWAP
+		swapspace[i].zdata = NULL;
+		swapspace[i].znext = -1;
+		swapspace[i].zprev = -1;
+		swapspace[i].zwb = 0;
+		swapspace[i].zfree = 0;
+#endif
+	}
+	swap_map_init(SWAP_SIZE);
+#if OPT_IPT
+	for (i=0; i<SWAP_HASH_SIZE; i++){
+		swap_hash[i] = -1;
 	}
+#endif
 	spinlock_release(&sw_lock);
 	strcpy(path, swapfilename);
 	
@@ -29,85 +150,367 @@ void swapspace_bootstrap(void){
 	if( result){
 		panic("\nError opening swapfile!\n");
 	}
+#if OPT_ZSWAP
+	zswap_bootstrap();
+	zs_wb_lock = lock_create("zswap writeback");
+	zs_page = frame_kalloc(1);
+	if(zs_wb_lock == NULL || zs_page == 0){
+		panic("\nCannot allocate the compressed pool!\n");
+	}
+#endif
 
 }
 /* 		
-* 	swap_in 
+* 	slot_alloc - next fit sulla bitmap: in media la prima parola esaminata ha uno slot libero. Restituisce -1 se lo
+*		     swapfile è pieno. Da chiamare con sw_lock acquisito.
 */
-void swap_in(struct addrspace* as, vaddr_t vaddr){
-	int i;
-	struct iovec iov;
-	struct uio u;
-	int result;
+static int slot_alloc(void){
+	unsigned int n, w;
+	int b;
 
-	spinlock_acquire(&sw_lock);
-	for(i=0; i<SWAP_SIZE; i++){
-		if((swapspace[i].as == as) && (swapspace[i].vaddr == vaddr)){
-			swapspace[i].as = NULL;
-			swapspace[i].vaddr = 0;
-		 	break;
+	for(n=0; n<SWAP_WORDS; n++){
+		w = (swap_cursor/32 + n) % SWAP_WORDS;
+		if(swap_map[w] == 0xffffffff){
+			continue;
+		}
+		for(b=0; swap_map[w] & (1U << b); b++);
+		swap_map[w] |= 1U << b;
+		swap_cursor = (w*32 + b + 1) % (SWAP_WORDS*32);
+		swap_used++;
+		return w*32 + b;
+	}
+	return -1;
+}
+/* 		
+* 	slot_alloc_run - come slot_alloc, ma per n slot consecutivi (n > 1). La ricerca parte dallo slot swap_cursor, salta
+*			 le parole piene e, arrivata in fondo, ricomincia dall'inizio fino a tornare al cursore. Restituisce il
+*			 primo slot, -1 se nessuna sequenza di n slot liberi è disponibile. Da chiamare con sw_lock acquisito.
+*/
+static int slot_alloc_run(int n){
+	unsigned int t, i;
+	int run = 0;
+
+	for(t=0; t<SWAP_WORDS*32+n-1; t++){		// n-1 slot in più: una sequenza può iniziare subito prima del cursore
+		i = (swap_cursor + t) % (SWAP_WORDS*32);
+		if(i == 0){
+			run = 0;			// una sequenza non prosegue oltre la fine dello swap
+		}
+		if(i%32 == 0 && swap_map[i/32] == 0xffffffff){
+			run = 0;
+			t += 31;
+			continue;
+		}
+		if(swap_map[i/32] & (1U << (i%32))){
+			run = 0;
+			continue;
+		}
+		if(++run < n){
+			continue;
+		}
+		i = i-n+1;
+		for(t=0; t<(unsigned int)n; t++){
+			swap_map[(i+t)/32] |= 1U << ((i+t)%32);
 		}
+		swap_cursor = (i+n) % (SWAP_WORDS*32);
+		swap_used += n;
+		return i;
 	}
+	return -1;
+}
+/* 		
+* 	slot_assign - associa lo slot i alla pagina vaddr di as. Da chiamare con sw_lock acquisito.
+*/
+static void slot_assign(int i, struct addrspace* as, vaddr_t vaddr){
+	swapspace[i].as = as;
+	swapspace[i].vaddr = vaddr;
+	swapspace[i].prev = -1;
+	swapspace[i].next = as->swap_slots;
+	if(as->swap_slots >= 0){
+		swapspace[as->swap_slots].prev = i;
+	}
+	as->swap_slots = i;
+#if OPT_IPT
+	swapspace[i].hash_next = swap_hash[IPT_HASH(as, vaddr, SWAP_HASH_SIZE-1)];
+	swap_hash[IPT_HASH(as, vaddr, SWAP_HASH_SIZE-1)] = i;
+#endif
+}
+#if OPT_ZSWAP
+/* 		
+* 	zs_unlink - toglie lo slot i dal pool, senza liberarne la pagina compressa. Da chiamare con sw_lock acquisito.
+*/
+static void zs_unlink(int i){
+	if(swapspace[i].zprev >= 0){
+		swapspace[swapspace[i].zprev].znext = swapspace[i].znext;
+	}
+	else{
+		zs_head = swapspace[i].znext;
+	}
+	if(swapspace[i].znext >= 0){
+		swapspace[swapspace[i].znext].zprev = swapspace[i].zprev;
+	}
+	else{
+		zs_tail = swapspace[i].zprev;
+	}
+	swapspace[i].znext = -1;
+	swapspace[i].zprev = -1;
+	zs_bytes -= swapspace[i].zlen;
+	swapspace[i].zdata = NULL;
+}
+/* 		
+* 	zs_store - comprime il frame paddr nel pool come contenuto dello slot i. Restituisce 0 se la pagina va scritta
+*		   nello swapfile.
+*/
+static int zs_store(int i, paddr_t paddr){
+	void* data;
+	unsigned int len;
+
+	len = zswap_compress(paddr, &data);
+	if(len == 0){
+		return 0;
+	}
+	spinlock_acquire(&sw_lock);
+	swapspace[i].zdata = data;
+	swapspace[i].zlen = len;
+	swapspace[i].zprev = zs_tail;
+	swapspace[i].znext = -1;
+	if(zs_tail >= 0){
+		swapspace[zs_tail].znext = i;
+	}
+	else{
+		zs_head = i;
+	}
+	zs_tail = i;
+	zs_bytes += len;
 	spinlock_release(&sw_lock);
-	if(i == SWAP_SIZE){
-		panic("Swapfile - vaddr not found!\n"); 
-	}
-	iov.iov_ubase = (userptr_t)vaddr;
-	iov.iov_len = PAGE_SIZE;	  // length of the memory space
-	u.uio_iov = &iov;
-	u.uio_iovcnt = 1;
-	u.uio_resid = PAGE_SIZE;          // amount to read from the file
-	u.uio_offset = i*PAGE_SIZE;
-	u.uio_segflg = UIO_USERSPACE;
-	u.uio_rw = UIO_READ;
-	u.uio_space = as;
-
-	result = VOP_READ(swapfile, &u);
-	if (result) {
-		panic("Swapfile - swap in error.\n");
+	vmstats_inc(ZSWAP_STORE);
+	vmstats_add(ZSWAP_BYTES, len);
+	return 1;
+}
+/* 		
+* 	zs_load - se lo slot i è nel pool decomprime la pagina nel frame paddr e restituisce 1. Se la pagina sta uscendo
+*		  dal pool si attende la fine della scrittura, dopo la quale va letta dallo swapfile.
+*/
+static int zs_load(int i, paddr_t paddr){
+	void* data;
+	unsigned int len;
+
+	spinlock_acquire(&sw_lock);
+	while(swapspace[i].zwb){
+		spinlock_release(&sw_lock);
+		thread_yield();
+		spinlock_acquire(&sw_lock);
 	}
-	print_swap_state("swap_in\n");
-	
+	data = swapspace[i].zdata;
+	len = swapspace[i].zlen;
+	if(data != NULL){
+		zs_unlink(i);
+	}
+	spinlock_release(&sw_lock);
+	if(data == NULL){
+		return 0;
+	}
+	zswap_decompress(data, len, (void *)PADDR_TO_KVADDR(paddr));
+	kfree(data);
+	vmstats_inc(ZSWAP_HIT);
+	return 1;
 }
+#endif
 /* 		
-* 	swap_out
+* 	slot_release - toglie lo slot i dalla lista di as e lo segna come libero. Da chiamare con sw_lock acquisito.
+*		       Restituisce la pagina compressa dello slot (o NULL), che il chiamante libera dopo aver rilasciato sw_lock.
 */
-void swap_out(struct addrspace* as, vaddr_t vaddr){
+static void* slot_release(struct addrspace* as, int i){
+	void* zdata = NULL;
+#if OPT_IPT
+	int* link;
+
+	for(link=&swap_hash[IPT_HASH(as, swapspace[i].vaddr, SWAP_HASH_SIZE-1)]; *link!=i; link=&swapspace[*link].hash_next){
+		KASSERT(*link >= 0);
+	}
+	*link = swapspace[i].hash_next;
+	swapspace[i].hash_next = -1;
+#endif
+	if(swapspace[i].prev >= 0){
+		swapspace[swapspace[i].prev].next = swapspace[i].next;
+	}
+	else{
+		as->swap_slots = swapspace[i].next;
+	}
+	if(swapspace[i].next >= 0){
+		swapspace[swapspace[i].next].prev = swapspace[i].prev;
+	}
+	swapspace[i].as = NULL;
+	swapspace[i].vaddr = 0;
+	swapspace[i].next = -1;
+	swapspace[i].prev = -1;
+#if OPT_ZSWAP
+	if(swapspace[i].zdata != NULL){
+		zdata = swapspace[i].zdata;
+		zs_unlink(i);
+	}
+	if(swapspace[i].zwb){
+		swapspace[i].zfree = 1;			// la pagina è in scrittura: lo slot non può essere riassegnato prima della fine
+		return zdata;
+	}
+#endif
+	swap_map[i/32] &= ~(1U << (i%32));
+	swap_used--;
+	return zdata;
+}
+#if OPT_ZSWAP
+/* 		
+* 	zs_shrink - scrive nello swapfile le pagine entrate nel pool da più tempo finché il pool non rientra in
+*		    ZSWAP_POOL_BYTES. Durante la scrittura la pagina non è più nel pool ma lo slot è segnato (zwb): zs_load
+*		    attende e slot_release non lo rende riassegnabile.
+*/
+static void zs_shrink(void){
 	int i, result;
-	struct iovec iov;
-	struct uio u;
-	
-	spinlock_acquire(&sw_lock);
-	
-	for(i=0; i<SWAP_SIZE; i++){
-		if(swapspace[i].as == NULL){
+	void* data;
+	unsigned int len;
+
+	lock_acquire(zs_wb_lock);
+	while(1){
+		spinlock_acquire(&sw_lock);
+		if(zs_bytes <= ZSWAP_POOL_BYTES || zs_head < 0){
+			spinlock_release(&sw_lock);
 			break;
 		}
+		i = zs_head;
+		data = swapspace[i].zdata;
+		len = swapspace[i].zlen;
+		zs_unlink(i);
+		swapspace[i].zwb = 1;
+		spinlock_release(&sw_lock);
+
+		zswap_decompress(data, len, (void *)PADDR_TO_KVADDR(zs_page));
+		kfree(data);
+		result = swap_io(i, &zs_page, 1, UIO_WRITE);
+		if (result) {
+			panic("Swapfile - swap out error.\n");
+		}
+		vmstats_inc(ZSWAP_WRITEBACK);
+
+		spinlock_acquire(&sw_lock);
+		swapspace[i].zwb = 0;
+		if(swapspace[i].zfree){
+			swapspace[i].zfree = 0;
+			swap_map[i/32] &= ~(1U << (i%32));
+			swap_used--;
+		}
+		spinlock_release(&sw_lock);
 	}
-	if(i == SWAP_SIZE){
-		panic("Swapfile - swapfile is full!\n"); 
+	lock_release(zs_wb_lock);
+}
+#endif
+/* 		
+* 	swap_in - gli slot letti dallo swapfile restano della pagina (swap cache). Quelli delle pagine trovate nel pool
+*		  compresso vengono liberati dopo la lettura, come la copia compressa: tenerla occuperebbe il pool per
+*		  pagine in memoria.
+*/
+void swap_in(struct addrspace* as, int slot, vaddr_t* vaddrs, paddr_t* paddrs, int n, int* cached){
+	int i, result;
+	char skip[SWAP_CLUSTER];			// pagine trovate nel pool compresso
+	void* zdata[SWAP_CLUSTER];
+
+	for(i=0; i<n; i++){
+		if(slot < 0 || slot+i >= SWAP_SIZE || swapspace[slot+i].as != as || swapspace[slot+i].vaddr != vaddrs[i]){
+			panic("Swapfile - vaddr not found!\n"); 
+		}
+#if OPT_ZSWAP
+		skip[i] = zs_load(slot+i, paddrs[i]);
+#else
+		skip[i] = 0;
+#endif
+	}
+	result = swap_io_runs(slot, paddrs, skip, n, UIO_READ);
+	if (result) {
+		panic("Swapfile - swap in error.\n");
 	}
 	
-	swapspace[i].as = as;
-	swapspace[i].vaddr = vaddr;
-	
+	spinlock_acquire(&sw_lock);
+	for(i=0; i<n; i++){
+		cached[i] = !skip[i];
+		zdata[i] = skip[i] ? slot_release(as, slot+i) : NULL;
+	}
 	spinlock_release(&sw_lock);
+	for(i=0; i<n; i++){
+		kfree(zdata[i]);
+	}
+}
+/* 		
+* 	swap_drop
+*/
+void swap_drop(struct addrspace* as, int slot){
+	void* zdata;
+
+	spinlock_acquire(&sw_lock);
+	KASSERT(slot >= 0 && slot < SWAP_SIZE && swapspace[slot].as == as);
+	zdata = slot_release(as, slot);
+	spinlock_release(&sw_lock);
+	kfree(zdata);
+}
+/* 		
+* 	swap_out - le pagine vengono scritte a gruppi di SWAP_CLUSTER in slot consecutivi, con una richiesta per gruppo.
+*		   Se lo swap è troppo frammentato per un gruppo, la pagina viene scritta da sola.
+*/
+void swap_out(struct swap_page* pages, int n){
+	int i, j, k, first, result;
+	paddr_t paddrs[SWAP_CLUSTER];
+	char skip[SWAP_CLUSTER];			// pagine entrate nel pool compresso
 	
-	iov.iov_ubase = (userptr_t)vaddr;
-	iov.iov_len = PAGE_SIZE;	  // length of the memory space
-	u.uio_iov = &iov;
-	u.uio_iovcnt = 1;
-	u.uio_resid = PAGE_SIZE;          // amount to write to the file
-	u.uio_offset = i*PAGE_SIZE;
-	u.uio_segflg = UIO_USERSPACE;
-	u.uio_rw = UIO_WRITE;
-	u.uio_space = as;
-	
-	result = VOP_WRITE(swapfile, &u);
-	if (result) {
-		panic("Swapfile - swap out error.\n");
+	for(i=0; i<n; i+=k){
+		k = (n-i < SWAP_CLUSTER)? n-i : SWAP_CLUSTER;
+		spinlock_acquire(&sw_lock);
+		first = (k > 1)? slot_alloc_run(k) : -1;
+		if(first < 0){
+			k = 1;
+			first = slot_alloc();
+		}
+		if(first < 0){
+			spinlock_release(&sw_lock);
+			// gli slot della swap cache sono copie di pagine ancora in memoria: se ne libera uno e si riprova
+			if(!cm_reclaim_slot()){
+				panic("Swapfile - swapfile is full!\n"); 
+			}
+			k = 0;
+			continue;
+		}
+		for(j=0; j<k; j++){
+			slot_assign(first+j, pages[i+j].as, pages[i+j].vaddr);
+			pages[i+j].slot = first+j;
+			paddrs[j] = pages[i+j].paddr;
+		}
+		spinlock_release(&sw_lock);
+		
+		for(j=0; j<k; j++){
+#if OPT_ZSWAP
+			skip[j] = zs_store(first+j, paddrs[j]);
+#else
+			skip[j] = 0;
+#endif
+		}
+		// le vittime possono appartenere ad altri processi: swap_io non usa il loro as
+		result = swap_io_runs(first, paddrs, skip, k, UIO_WRITE);
+		if (result) {
+			panic("Swapfile - swap out error.\n");
+		}
+	}
+#if OPT_ZSWAP
+	zs_shrink();
+#endif
+}
+/* 		
+* 	swap_neighbours
+*/
+int swap_neighbours(struct addrspace* as, int slot, vaddr_t* vaddrs, int max){
+	int n;
+
+	spinlock_acquire(&sw_lock);
+	for(n=0; n<max && slot+1+n < SWAP_SIZE && swapspace[slot+1+n].as == as; n++){
+		vaddrs[n] = swapspace[slot+1+n].vaddr;
 	}
-	print_swap_state("swap_out\n");
+	spinlock_release(&sw_lock);
+	return n;
 }
 /* 		
 * 	print_swap_state
@@ -117,7 +520,11 @@ void print_swap_state(const char* msg){
 	kprintf("%s",msg);
 	for(i=0;i<SWAP_SIZE; i++){
 		if(swapspace[i].as!=NULL){
+#if OPT_ZSWAP
+			kprintf("%d - %#010x%s\n",i,swapspace[i].vaddr,swapspace[i].zdata != NULL ? " (compressa)" : "");
+#else
 			kprintf("%d - %#010x\n",i,swapspace[i].vaddr);
+#endif
 		}
 	}
 	kprintf("\n");
@@ -126,20 +533,100 @@ void print_swap_state(const char* msg){
 * 	swap_asfree
 */
 void swap_asfree(struct addrspace* as){
-	int i;
+	void* zdata;
+
 	spinlock_acquire(&sw_lock);
-	for(i=0; i<SWAP_SIZE; i++){
-		if(swapspace[i].as == as){
-			swapspace[i].as = NULL;
-			swapspace[i].vaddr = 0;
+	while(as->swap_slots >= 0){
+		zdata = slot_release(as, as->swap_slots);
+		if(zdata != NULL){			// kfree non si chiama con uno spinlock acquisito
+			spinlock_release(&sw_lock);
+			kfree(zdata);
+			spinlock_acquire(&sw_lock);
 		}
 	}
 	spinlock_release(&sw_lock);
 }
+#if OPT_IPT
+/* 		
+* 	swap_lookup
+*/
+int swap_lookup(struct addrspace* as, vaddr_t vaddr){
+	int i;
+
+	spinlock_acquire(&sw_lock);
+	i = slot_hash_find(as, vaddr);
+	spinlock_release(&sw_lock);
+	return i;
+}
+#endif
+/* 		
+* 	swap_close - chiude lo swapfile o rilascia il disco raw.
+*/
+static void swap_close(struct vnode* v, struct device* dev, const char* devname){
+	if(dev == NULL){
+		vfs_close(v);
+		return;
+	}
+	VOP_DECREF(v);
+	vfs_swapoff(devname);
+}
+/* 		
+* 	swap_setdevice - il nuovo dispositivo viene attivato solo se lo swap è vuoto, ricontrollato con sw_lock dopo
+*			 vfs_swapon: gli slot già scritti resterebbero sul dispositivo precedente.
+*/
+int swap_setdevice(const char* devname){
+	struct vnode* v;
+	struct vnode* oldfile;
+	struct device* olddev;
+	char oldname[SWAP_DEVNAME_LEN];
+	char name[SWAP_DEVNAME_LEN];
+	struct stat st;
+	int result, nslots;
+
+	if(strlen(devname) >= SWAP_DEVNAME_LEN){
+		return ENAMETOOLONG;
+	}
+	strcpy(name, devname);
+	if(name[0] != 0 && name[strlen(name)-1] == ':'){
+		name[strlen(name)-1] = 0;		// vfs_swapoff non accetta i due punti finali
+	}
+	result = vfs_swapon(name, &v);
+	if(result){
+		return result;
+	}
+	result = VOP_STAT(v, &st);
+	nslots = (result == 0)? st.st_size / PAGE_SIZE : 0;
+	if(nslots > SWAP_SIZE){
+		nslots = SWAP_SIZE;			// il vettore swapspace ha SWAP_SIZE entry
+	}
+	if(nslots == 0){
+		swap_close(v, v->vn_data, name);
+		return result ? result : ENOSPC;
+	}
+
+	spinlock_acquire(&sw_lock);
+	if(swap_used > 0){
+		spinlock_release(&sw_lock);
+		swap_close(v, v->vn_data, name);
+		return EBUSY;
+	}
+	oldfile = swapfile;
+	olddev = swapdev;
+	strcpy(oldname, swapdevname);
+	swapfile = v;
+	swapdev = v->vn_data;
+	strcpy(swapdevname, name);
+	swap_map_init(nslots);
+	spinlock_release(&sw_lock);
+
+	swap_close(oldfile, olddev, oldname);
+	kprintf("swap: %s, %d pages\n", name, nslots);
+	return 0;
+}
 /* 		
 * 	swapspace_shutdown 
 */
 void swapspace_shutdown(void){
 	kfree(swapspace);
-	vfs_close(swapfile);
+	swap_close(swapfile, swapdev, swapdevname);
 }
@@ -1,4 +1,33 @@
 #include "tlb.h"
+#include "coremap.h"
+#include <current.h>
+
+static struct stlb_entry stlb[MAXCPUS][STLB_SIZE];	// tlb software, una per CPU
+static unsigned int stlb_nextid = 1;
+static struct spinlock stlb_lock = SPINLOCK_INITIALIZER;	// protegge stlb_nextid
+
+static struct asid_cpu{
+	unsigned int gen;		// generazione corrente degli ASID, 0 prima della prima attivazione
+	unsigned int next;		// prossimo ASID libero nella generazione
+	unsigned int cur;		// ASID dell'as attivo
+}asid_state[MAXCPUS];			// per CPU, modificato solo dalla CPU proprietaria con interrupt disabilitati
+
+#define TLBHI(vaddr, asid) (((vaddr) & TLBHI_VPAGE) | ((asid) << TLBHI_PIDSHIFT))
+
+#define TLB_WORDS (NUM_TLB/32)
+#define TLB_BIT(map, i) ((map)[(i) >> 5] & (1U << ((i) & 31)))
+#define TLB_SET(map, i) ((map)[(i) >> 5] |= (1U << ((i) & 31)))
+#define TLB_CLEAR(map, i) ((map)[(i) >> 5] &= ~(1U << ((i) & 31)))
+
+static struct tlb_cpu{
+	uint32_t used[TLB_WORDS];	// slot scritti da tlbW, o trovati occupati dal refill, e non ancora invalidati
+	uint32_t ref[TLB_WORDS];	// nru: slot scritti o resi scrivibili dopo l'ultimo passaggio della lancetta
+	unsigned int hand;		// prossimo slot esaminato da rr e nru
+}tlb_state[MAXCPUS];			// per CPU, acceduto solo dalla CPU proprietaria con interrupt disabilitati
+
+static int tlb_repl = TLB_REPL_DEFAULT;
+
+#define STLB_INDEX(id, vaddr) ((((vaddr) >> 12) ^ ((id) * 7)) & (STLB_SIZE-1))
 /*
 *	tlb_print
 */
@@ -15,88 +44,271 @@ void tlb_print(void){
 }
 
 /*
-*	tlb_get_rr_victim
+*	tlb_free_slot - primo slot libero, -1 se la tlb è piena. Gli slot riempiti dal refill in assembly (tlbwr) non
+*			compaiono nella bitmap: uno slot libero secondo la bitmap viene letto e, se il refill lo ha occupato,
+*			segnato come usato. La bitmap si aggiorna così solo per gli slot consultati.
 */
-static int tlb_get_rr_victim(void){
+static int tlb_free_slot(struct tlb_cpu* t){
+	int w, b;
+	uint32_t ehi, elo;
+	for (w=0; w<TLB_WORDS; w++) {
+		while (t->used[w] != 0xffffffff) {
+			for (b=0; t->used[w] & (1U << b); b++);
+			tlb_read(&ehi, &elo, w*32 + b);
+			if (!(elo & TLBLO_VALID)) {
+				return w*32 + b;
+			}
+			t->used[w] |= 1U << b;
+		}
+	}
+	return -1;
+}
+/*
+*	tlb_get_victim - rr: slot successivo; nru: primo slot dalla lancetta non scritto dopo l'ultimo passaggio, azzerando
+*			 il bit degli slot saltati (dopo un giro completo tutti i bit sono azzerati).
+*/
+static int tlb_get_victim(struct tlb_cpu* t){
 	int victim;
-	static unsigned int next_victim = 0;
-	victim = next_victim;
-	next_victim = (next_victim+1) % NUM_TLB;
-	return victim;
+	for (;;) {
+		victim = t->hand;
+		t->hand = (t->hand+1) % NUM_TLB;
+		if (tlb_repl != TLB_REPL_NRU || !TLB_BIT(t->ref, victim)) {
+			return victim;
+		}
+		TLB_CLEAR(t->ref, victim);
+	}
+}
+/*
+*	tlb_set_repl
+*/
+void tlb_set_repl(int repl){
+	KASSERT(repl == TLB_REPL_RR || repl == TLB_REPL_RANDOM || repl == TLB_REPL_NRU);
+	tlb_repl = repl;
+}
+/*
+*	tlb_get_repl
+*/
+int tlb_get_repl(void){
+	return tlb_repl;
 }
 /*
-*	tlbR - Replace
+*	tlb_activate
 */
-void tlbR(vaddr_t victim,vaddr_t faultaddress, paddr_t paddr){
+int tlb_activate(struct tlb_asid* ids){
+	int spl;
+	int flushed = 0;
+	struct asid_cpu* st;
+	struct tlb_asid* id;
 	
+	spl = splhigh();
+	st = &asid_state[curcpu->c_number];
+	id = &ids[curcpu->c_number];
+	if(st->gen == 0 || id->gen != st->gen){
+		if(st->gen == 0 || st->next == NUM_ASID){
+			tlb_invalidate_all();		// ASID esauriti: le entry della generazione precedente non devono più essere trovate
+			st->gen++;
+			if(st->gen == 0){
+				st->gen = 1;		// 0 indica un as a cui non è mai stato assegnato un ASID
+			}
+			st->next = 1;
+			flushed = 1;
+		}
+		id->gen = st->gen;
+		id->asid = st->next++;
+	}
+	st->cur = id->asid;
+	tlb_setasid(id->asid);
+	splx(spl);
+	return flushed;
+}
+/*
+*	tlb_invalidate - l'ASID del proprietario su questa CPU non è noto a chi riceve uno shootdown (l'as può essere già
+*			 stato distrutto): si confronta solo la pagina. Invalidare la entry di un altro as costa solo un refill.
+*/
+void tlb_invalidate(vaddr_t vaddr){
 	int spl;
-	int x;	
+	int i;
 	uint32_t ehi, elo;
 	spl = splhigh();
-	
-	ehi = victim;
-	x = tlb_probe( ehi, 0);
-	if (x >= 0){
-		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;  // perche la pagina che deve essere riempita dev essere scrivibile
-		tlb_write(ehi, elo, x);
-		vmstats_inc(TLB_FAULT_FREE);
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_read(&ehi, &elo, i);
+		if ((ehi & TLBHI_VPAGE) == vaddr) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+			TLB_CLEAR(tlb_state[curcpu->c_number].used, i);
+		}
 	}
 	splx(spl);
 }
 /*
-*	tlbW - Write
+*	tlb_invalidate_all
 */
-void tlbW(vaddr_t faultaddress, paddr_t paddr, int write){ // write != 0 -> dirty bit=1
+void tlb_invalidate_all(void){
+	int spl;
+	int i;
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	bzero(tlb_state[curcpu->c_number].used, sizeof(tlb_state[curcpu->c_number].used));
+	splx(spl);
+}
+/*
+*	tlb_set_dirty
+*/
+void tlb_set_dirty(vaddr_t vaddr){
 	int spl;
 	int i;
 	uint32_t ehi, elo;
 	spl = splhigh();
-	//tlb_print();
-	ehi = faultaddress;
-	elo = paddr | TLBLO_VALID;
-	if(write>0){
-		elo = elo | TLBLO_DIRTY ;
+	i = tlb_probe(TLBHI(vaddr, asid_state[curcpu->c_number].cur), 0);
+	if (i >= 0){
+		tlb_read(&ehi, &elo, i);
+		tlb_write(ehi, elo | TLBLO_DIRTY, i);
+		TLB_SET(tlb_state[curcpu->c_number].ref, i);		// la pagina è appena stata scritta
+	}
+	splx(spl);
+}
+/*
+*	tlb_sweep - il bit di riferimento viene azzerato e la entry resta in tlb senza TLBLO_VALID: corrisponde ancora alla
+*		    pagina, quindi il prossimo accesso non passa dal refill in assembly ma causa un'eccezione TLB invalid, e
+*		    vm_fault rialza il bit con cm_touch. Le entry degli altri ASID sono di processi non in esecuzione su questa
+*		    CPU e restano valide.
+*/
+unsigned int tlb_sweep(void){
+	int spl;
+	int i;
+	unsigned int n = 0;
+	uint32_t ehi, elo, asid;
+	spl = splhigh();
+	asid = asid_state[curcpu->c_number].cur;
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_read(&ehi, &elo, i);
+		if (!(elo & TLBLO_VALID) || ((ehi & TLBHI_PID) >> TLBHI_PIDSHIFT) != asid) {
+			continue;
+		}
+		tlb_write(ehi, elo & ~TLBLO_VALID, i);
+		TLB_CLEAR(tlb_state[curcpu->c_number].used, i);
+		cm_clear_ref(elo & TLBLO_PPAGE);
+		n++;
+	}
+	splx(spl);
+	return n;
+}
+/*
+*	stlb_newid
+*/
+unsigned int stlb_newid(void){
+	unsigned int id;
+
+	spinlock_acquire(&stlb_lock);
+	id = stlb_nextid++;
+	if(stlb_nextid == 0){
+		stlb_nextid = 1;		// dopo 2^32 as: un id può essere riusato solo da un as creato molto dopo
+	}
+	spinlock_release(&stlb_lock);
+	return id;
+}
+/*
+*	stlb_lookup - la tlb software è acceduta solo dalla CPU proprietaria con interrupt disabilitati.
+*/
+int stlb_lookup(unsigned int id, vaddr_t vaddr, pt_entry* pte){
+	struct stlb_entry* e;
+	int spl, hit;
+
+	spl = splhigh();
+	e = &stlb[curcpu->c_number][STLB_INDEX(id, vaddr)];
+	hit = (e->id == id && e->vaddr == vaddr);
+	if(hit){
+		*pte = e->pte;
+	}
+	splx(spl);
+	return hit;
+}
+/*
+*	stlb_insert
+*/
+void stlb_insert(unsigned int id, vaddr_t vaddr, pt_entry pte){
+	struct stlb_entry* e;
+	int spl;
+
+	spl = splhigh();
+	e = &stlb[curcpu->c_number][STLB_INDEX(id, vaddr)];
+	e->id = id;
+	e->vaddr = vaddr;
+	e->pte = pte;
+	splx(spl);
+}
+/*
+*	stlb_invalidate
+*/
+void stlb_invalidate(unsigned int id, vaddr_t vaddr){
+	struct stlb_entry* e;
+	int spl;
+
+	spl = splhigh();
+	e = &stlb[curcpu->c_number][STLB_INDEX(id, vaddr)];
+	if(e->id == id && e->vaddr == vaddr){
+		e->id = 0;
 	}
+	splx(spl);
+}
+/*
+*	stlb_invalidate_all
+*/
+void stlb_invalidate_all(void){
+	int spl;
+	int i;
+
+	spl = splhigh();
+	for(i=0; i<STLB_SIZE; i++){
+		stlb[curcpu->c_number][i].id = 0;
+	}
+	splx(spl);
+}
+/*
+*	tlbW - Write
+*/
+void tlbW(vaddr_t faultaddress, pt_entry pte){ // la entry della pt ha già il formato di EntryLo
+	int spl;
+	int i;
+	uint32_t ehi, elo;
+	struct tlb_cpu* t;
+	spl = splhigh();
+	t = &tlb_state[curcpu->c_number];
+	ehi = TLBHI(faultaddress, asid_state[curcpu->c_number].cur);
+	elo = pte & PTE_TLBLO;
 	
-	i = tlb_probe( ehi, 0);
+	i = tlb_probe(ehi, 0);
 	if (i >= 0){
 		//qui non viene aggiornto nessun contatore perchè siamo in un TLB HIT 
 		tlb_write(ehi, elo, i);
+		TLB_SET(t->used, i);
+		TLB_SET(t->ref, i);
 		splx(spl);
 		vmstats_inc(TLB_FAULT_FREE);
 		return;
 	}
 	
-	//cerca il primo posto valido altrimenti rimpiazzo con politica RR 
-	for (i=0; i<NUM_TLB; i++) {	
-		tlb_read(&ehi, &elo, i);
-		if (elo & TLBLO_VALID) {
-			continue;
-		}
-		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
-		ehi = faultaddress;
-		elo = paddr | TLBLO_VALID;
-		if(write>0){
-			elo = elo | TLBLO_DIRTY ;
-		}
-		//kprintf("TLB :: vaddr 0x%x - paddr 0x%x \n",ehi,elo);
+	// primo slot libero secondo la bitmap, altrimenti una vittima con la politica selezionata (tlb_set_repl)
+	i = tlb_free_slot(t);
+	if (i >= 0){
+		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, PTE_PADDR(pte));
 		tlb_write(ehi, elo, i);
+		TLB_SET(t->used, i);
+		TLB_SET(t->ref, i);
 		splx(spl);
 		vmstats_inc(TLB_FAULT_FREE);
 		return;
 	}
 
-	// TLB piena, uso politica di rimpiazzamento RR
-	// kprintf("TLB piena!\n");
-	i = tlb_get_rr_victim();
-	ehi = faultaddress;
-	elo = paddr | TLBLO_VALID;
-	if(write>0){
-		elo = elo | TLBLO_DIRTY ;
-	}
-	tlb_write(ehi, elo, i);
+	if (tlb_repl == TLB_REPL_RANDOM){
+		tlb_random(ehi, elo);			// slot scelto dal processore, come nel refill in assembly
+	}
+	else{
+		i = tlb_get_victim(t);
+		tlb_write(ehi, elo, i);
+		TLB_SET(t->ref, i);
+	}
 	splx(spl);
 	vmstats_inc(TLB_FAULT_REPLACE);
 }
-
@@ -35,6 +35,8 @@
 #include <spinlock.h>
 #include <proc.h>
 #include <current.h>
+#include <thread.h>
+#include <clock.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
@@ -70,6 +72,8 @@
  */
 static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 
+static unsigned int refsweep_ticks = CM_REFSWEEP_TICKS;	// intervallo dello sweep del bit di riferimento, 0 = disabilitato
+
 void
 vm_bootstrap(void)
 {
@@ -152,11 +156,53 @@ free_kpages(vaddr_t addr)
 	}
 }
 
+/*
+*	vm_tlbshootdown - con gli ASID la tlb contiene anche pagine di as non in esecuzione su questa CPU, così come la
+*			  tlb software: la entry va invalidata comunque. ts_as può essere già stato distrutto, quindi non se
+*			  ne legge l'ASID: tlb_invalidate confronta solo la pagina.
+*/
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	tlb_invalidate(ts->ts_vaddr);
+	stlb_invalidate(ts->ts_id, ts->ts_vaddr);
+}
+
+void
+vm_tlbshootdown_all(void)
+{
+	tlb_invalidate_all();
+	stlb_invalidate_all();
+}
+
+/*
+*	vm_refsweep - chiamata da hardclock su ogni CPU. La tlb è per-CPU, quindi ogni CPU azzera il bit delle pagine che
+*		      ha in tlb: una pagina che non è in nessuna tlb mantiene il bit finché non la azzera la politica.
+*/
+void
+vm_refsweep(void)
+{
+	unsigned int ticks = refsweep_ticks;
+	unsigned int n;
+
+	if (ticks == 0 || (curcpu->c_hardclocks % ticks) != 0) {
+		return;
+	}
+	n = tlb_sweep();
+	vmstats_inc(REF_SWEEP);
+	vmstats_add(REF_SWEEP_INVALID, n);
+}
+
+void
+vm_set_refsweep(unsigned ticks)
+{
+	refsweep_ticks = ticks;
+}
+
+unsigned
+vm_get_refsweep(void)
+{
+	return refsweep_ticks;
 }
 
 /*
@@ -181,6 +227,19 @@ static size_t compute_memsz(segment_entry *segment, int i){
 	return memsz;
 }
 /*
+*	compute_filesz - byte della pagina i presenti nel file elf. Le pagine oltre filesz del segmento (bss) non si leggono.
+*/
+static size_t compute_filesz(segment_entry *segment, int i, size_t memsz){
+	size_t start;
+	
+	// posizione del primo byte da caricare nella pagina rispetto all'inizio del segmento
+	start = (i==1)? 0 : (i-1)*PAGE_SIZE - (segment->offset&~PAGE_FRAME);
+	if(start >= segment->filesz){
+		return 0;
+	}
+	return (segment->filesz - start < memsz)? segment->filesz - start : memsz;
+}
+/*
 *	compute_offset
 */
 static off_t compute_offset(off_t offset,int i){
@@ -193,31 +252,254 @@ static off_t compute_offset(off_t offset,int i){
 	}
 	return ret;
 }
+#if OPT_IPT
+/*
+*	ipt_pte - ricostruisce la entry della pagina vaddr di as dalla page table invertita (frame e dirty) e dalla tabella
+*		  hash dello swapfile. Il permesso di scrittura viene dal segmento.
+*/
+static pt_entry ipt_pte(struct addrspace* as, vaddr_t vaddr, int write){
+	pt_entry pte = write ? PTE_WRITE : 0;
+	paddr_t paddr;
+	int dirty, slot;
+
+	paddr = cm_lookup(as, vaddr, &dirty);
+	if(paddr != 0){
+		return PTE_MAP(pte, paddr, dirty);
+	}
+	slot = swap_lookup(as, vaddr);
+	if(slot >= 0){
+		return PTE_SWAP(pte, slot);
+	}
+	return pte;
+}
+#endif
 /*
-*	handle_victim_and_swapout
+*	evict_unmap - sceglie una vittima per as (NULL per il pageout daemon) e la toglie al proprietario, senza ancora
+*		      scriverla. Al ritorno il frame è LOADING e sp descrive la pagina; in dirty restituisce se va scritta
+*		      nello swapfile. Una vittima CLEAN ancora nel suo slot (swap cache) ha sp->slot già assegnato.
+*		      Restituisce il proprietario, NULL se non c'è nessuna vittima.
 */
 static
-int handle_victim_and_swapout(struct addrspace* as,paddr_t* paddr,vaddr_t faultaddress){
+struct addrspace* evict_unmap(struct addrspace* as, struct swap_page* sp, int* pos, int* dirty){
+	
+	struct tlbshootdown ts;
+	
+	sp->vaddr = cm_evict(as, &sp->as, &sp->paddr, pos, dirty, &sp->slot); 	// seleziona la vittima con la politica attiva (cm_set_policy). Restituisce vaddr,
+										// proprietario, paddr, posizione nella coremap, se è stata modificata e lo slot.
+	if(sp->as == NULL){
+		return NULL;
+	}
+	
+	/*
+	* La vittima non deve più essere accessibile dal proprietario prima di essere scritta nello swapfile.
+	* Con gli ASID la pagina può essere nella tlb di qualsiasi CPU su cui il proprietario è stato eseguito, anche se
+	* ora è in esecuzione un altro processo: lo shootdown invalida la entry su questa CPU e su tutte le altre, e
+	* attende che ogni CPU lo abbia fatto: solo dopo il frame può essere scritto o riassegnato.
+	*/
+#if !OPT_IPT
+	pt_evicting(sp->as->pt, sp->vaddr);		// prima dello shootdown: il refill in assembly non deve reinserire la entry
+#endif
+	ts.ts_as = sp->as;
+	ts.ts_id = sp->as->stlb_id;
+	ts.ts_vaddr = sp->vaddr;
+	ipi_tlbshootdown_broadcast(&ts);
+	
+	if(*dirty){
+		vmstats_inc(SWAP_FILE_WRITE);
+	}
+	else if(sp->slot >= 0){
+		vmstats_inc(SWAP_CACHE_HIT);		// la copia nello slot è ancora identica: basta aggiornare la pt
+	}
+	else{
+		vmstats_inc(PAGE_DISCARD);		// la pagina è identica all'elf o azzerata: al prossimo accesso verrà ricaricata
+	}
+	return sp->as;
+}
+/*
+*	evict_done - completa l'eviction di sp, già nello swapfile (sp->slot) o scartata (sp->slot = -1).
+*/
+static
+void evict_done(struct swap_page* sp){
+#if OPT_IPT
+	cm_unmap(sp->paddr);				// da qui il fault del proprietario cerca la pagina nello swapfile
+#else
+	pt_update(sp->as->pt, sp->vaddr, sp->slot); 	// segna nella pt del proprietario che la pagina non è piu in memoria
+#endif
+	cm_evict_done(sp->as);
+}
+/*
+*	evict_page - eviction di una sola pagina: evict_unmap, scrittura nello swapfile se DIRTY, evict_done. Restituisce
+*		     ENOMEM se non c'è nessuna vittima.
+*/
+static
+int evict_page(struct addrspace* as, paddr_t* paddr, int* pos){
 		
-	int pos;
-	vaddr_t victim;
+	int dirty;
+	struct swap_page sp;
 	
-	vmstats_inc(SWAP_FILE_WRITE);
-
-	victim = cm_evict(as, paddr, &pos); 	// seleziona la vittima scorrendo la coremap, politica FIFO. Restituisce vaddr, paddr e posizione nella coremap.
-					   	// coremap[pos] dovrà essere riempita con il nuovo vaddr.
+	if(evict_unmap(as, &sp, pos, &dirty) == NULL){
+		return ENOMEM;
+	}
+	if(dirty){
+		swap_out(&sp, 1);			// scrittura del frame nello swapfile
+	}
+	evict_done(&sp);
+	*paddr = sp.paddr;
+	return 0;
+}
+/*
+*	swap_readahead - alloca i frame per le pagine di as negli slot successivi a slot, da leggere insieme alla pagina del
+*			 fault (al più SWAP_READAHEAD). Solo finché il pageout daemon non deve liberare frame: le pagine lette
+*			 in anticipo non devono far uscire pagine in uso. Restituisce il numero di pagine in vaddrs e paddrs.
+*/
+static
+int swap_readahead(struct addrspace* as, int slot, vaddr_t* vaddrs, paddr_t* paddrs){
+#if OPT_IPT
+	/*
+	* Senza page table non si può sapere se una pagina vicina ha ancora il frame nella page table invertita
+	* mentre viene scritta nello slot: nessuna lettura anticipata.
+	*/
+	(void)as;
+	(void)slot;
+	(void)vaddrs;
+	(void)paddrs;
+	return 0;
+#else
+	int i, n;
+	pt_entry* pte;
+
+	n = swap_neighbours(as, slot, vaddrs, SWAP_READAHEAD);
+	for(i=0; i<n && !cm_pageout_needed(); i++){
+		// la pagina può avere lo slot mentre la sua eviction non è ancora terminata (PTE_EVICTING)
+		pte = pt_lookup(as->pt, vaddrs[i]);
+		if(pte == NULL || !PTE_IN_SWAP(*pte) || PTE_SLOT(*pte) != slot+1+i){
+			break;
+		}
+		paddrs[i] = frame_alloc(vaddrs[i], as, 0);
+		if(paddrs[i] == 0){
+			break;
+		}
+		*pte = PTE_MAP(*pte, paddrs[i], 1);
+		vmstats_inc(SWAP_READAHEAD_PAGE);
+	}
+	return i;
+#endif
+}
+/*
+*	handle_victim_and_swapout - eviction sincrona, quando il pageout daemon non ha lasciato frame liberi. Restituisce
+*				    ENOMEM se nessun frame utente può essere liberato.
+*/
+static
+int handle_victim_and_swapout(struct addrspace* as,paddr_t* paddr,vaddr_t faultaddress){
 	
-	swap_out(as, victim);			// scrittura del frame nello swapfile
-	pt_update(as->pt, victim); 		// scorre tutte le entry della pt per cercare la vittima e segnare che non è piu in memoria ( in_swap = 1 )
-	cm_update_vaddr(as, pos, faultaddress); // Aggiorna coremap[pos] con il nuovo vaddr
-
-	if(*paddr == 0)
-		return EFAULT;
-	tlbR(victim,faultaddress,*paddr);
+	int pos;
+	
+	vmstats_inc(PAGEOUT_SYNC);
+	if(evict_page(as, paddr, &pos)){
+		return ENOMEM;
+	}
+	cm_update_vaddr(as, pos, faultaddress); 	// Aggiorna coremap[pos] con il nuovo vaddr
 	
 	return 0;
 }
 /*
+*	vm_pageout - pageout daemon. Libera frame finché i frame liberi non raggiungono CM_FREE_HIGH, così che i page fault
+*		     trovino un frame libero senza dover scrivere una vittima nello swapfile.
+*/
+static
+void
+vm_pageout(void *data1, unsigned long data2)
+{
+	int i, n, ndirty, pos, dirty;
+	struct swap_page victims[CM_PAGEOUT_BATCH];	// prima le ndirty vittime da scrivere, poi quelle da scartare
+	struct swap_page sp;
+
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		cm_pageout_wait();
+		vmstats_inc(PAGEOUT_WAKEUP);
+		while (cm_pageout_needed()) {
+			/*
+			* Le vittime del lotto vengono raccolte prima di scriverle, così che swap_out possa assegnare loro slot
+			* consecutivi e scriverle con una sola richiesta al disco (SWAP_CLUSTER pagine).
+			*/
+			for (n=0, ndirty=0; n<CM_PAGEOUT_BATCH && cm_pageout_needed(); n++) {
+				if (evict_unmap(NULL, &sp, &pos, &dirty) == NULL) {
+					break;
+				}
+				if (dirty) {
+					victims[n] = victims[ndirty];
+					victims[ndirty++] = sp;
+				}
+				else {
+					victims[n] = sp;
+				}
+			}
+			if (ndirty > 0) {
+				swap_out(victims, ndirty);
+			}
+			for (i=0; i<n; i++) {
+				evict_done(&victims[i]);
+				frame_free(victims[i].paddr);
+				vmstats_inc(PAGEOUT_FREED);
+			}
+			if (n < CM_PAGEOUT_BATCH && cm_pageout_needed()) {
+				clocksleep(1);		// tutti i processi sono alla loro riserva: si riprova più tardi
+			}
+			else {
+				thread_yield();
+			}
+		}
+	}
+}
+
+void
+vm_pageout_bootstrap(void)
+{
+	int result;
+
+	cm_pageout_bootstrap();
+	result = thread_fork("pageout", NULL, vm_pageout, NULL, 0);
+	if (result) {
+		panic("Cannot start pageout daemon: %s\n", strerror(result));
+	}
+}
+/*
+*	vm_pagezero - riempie il pool di frame azzerati. Cede la CPU dopo ogni frame, così da lavorare solo quando gli
+*		      altri thread non hanno bisogno della CPU.
+*/
+static
+void
+vm_pagezero(void *data1, unsigned long data2)
+{
+	paddr_t paddr;
+
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		cm_zero_wait();
+		while ((paddr = cm_zero_take()) != 0) {
+			bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+			cm_zero_add(paddr);
+			thread_yield();
+		}
+	}
+}
+
+void
+vm_pagezero_bootstrap(void)
+{
+	int result;
+
+	result = thread_fork("pagezero", NULL, vm_pagezero, NULL, 0);
+	if (result) {
+		panic("Cannot start pagezero thread: %s\n", strerror(result));
+	}
+}
+/*
 *	vm_fault
 */
 int
@@ -238,7 +520,6 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		panic("dumbvm: got VM_FAULT_READONLY 0x%x\n", faultaddress);
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -279,139 +560,236 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	
 	
 #elif !OPT_ONDEMAND /* PAGINAZIONE - il file elf è gia stato interamente caricato in memoria */
-	segment_entry* seg = as->segments;
-	while(seg != NULL){
-		vaddr_t end = seg->first_addr+(seg->npages*PAGE_SIZE);
-		if(faultaddress >= seg->first_addr && faultaddress < end){
-			break;
-		}
-		seg = (segment_entry*)seg->next;
-	}
+	segment_entry* seg = sgm_lookup(&as->segments, faultaddress);
 	
 	if(seg == NULL){
 		return EFAULT;
 	}
 	
-	i=1; // per contare le pagine
-	pt_entry* pte = seg->first_pt_entry;
-	while(pte != NULL){
-		if(faultaddress == pte->page){
-			paddr = pte->frame;
-			break;
-		}
-		pte = (pt_entry*)pte->next;
-		i++;
-	}		
+	paddr = PTE_PADDR(*pt_lookup(as->pt, faultaddress));
+	
+	/*
+	* Le pagine caricate in anticipo sono sempre scrivibili. La pagina può avere già una entry in tlb: in sola lettura,
+	* scritta dal refill per un segmento di sola lettura (nella pt non ha PTE_DIRTY), o resa non valida da tlb_sweep.
+	* tlbW la sostituisce invece di aggiungerne una seconda per lo stesso indirizzo.
+	*/
+	tlbW(faultaddress, paddr | PTE_VALID | PTE_DIRTY);
+	return 0;
 	
 #else	/* PAGINAZIONE ON DEMAND - il file elf non è stato caricato in memoria, i frame vengono caricati solo quando ce n'è bisogno */
 
-	vmstats_inc(TLB_FAULT);
-	
 	size_t memsz, filesz;
 	off_t offset;
-	int result;
+	int result, slot, n, j;
+	vaddr_t kvaddr;
+	vaddr_t vaddrs[1+SWAP_READAHEAD];	// pagina del fault e pagine lette in anticipo
+	paddr_t paddrs[1+SWAP_READAHEAD];
+	int cached[1+SWAP_READAHEAD];		// lo slot contiene ancora una copia della pagina
+	pt_entry* p;
+	frame_state loaded;
+	pt_entry hit;
 	
-	// cerco il segmento corrispondente
-	segment_entry* seg = as->segments;
-	while(seg != NULL){
-		vaddr_t end = seg->first_addr+(seg->npages*PAGE_SIZE);
-		if(faultaddress >= seg->first_addr && faultaddress < end){
-			break;
+	if(faulttype == VM_FAULT_READONLY){
+		vmstats_inc(PAGE_DIRTY);		// la entry è in tlb: non è un TLB fault
+	}
+	else{
+		vmstats_inc(TLB_FAULT);
+		
+		/*
+		* TLB reload dalla tlb software: nessun accesso a segmenti, pt o cm_lock. Il controllo del proprietario del frame,
+		* con interrupt disabilitati, esclude una vittima già scelta il cui shootdown non è ancora arrivato.
+		*/
+		spl = splhigh();
+		if(stlb_lookup(as->stlb_id, faultaddress, &hit)){
+			if(cm_check_owner(PTE_PADDR(hit), as, faultaddress)){
+				vmstats_inc(TLB_RELOAD);
+				cm_policy_stat(REPL_HIT);
+				vmstats_inc(STLB_HIT);
+				cm_touch(PTE_PADDR(hit));
+				tlbW(faultaddress, hit);
+				splx(spl);
+				return 0;
+			}
+			stlb_invalidate(as->stlb_id, faultaddress);
 		}
-		seg = (segment_entry*)seg->next;
+		splx(spl);
 	}
 	
+	// cerco il segmento corrispondente: ultimo segmento trovato o ricerca binaria
+	segment_entry* seg = sgm_lookup(&as->segments, faultaddress);
+	
 	if(seg == NULL){
 		return EFAULT;
 	}
 	
-	//cerco tra le pagine del segmento corrispondente
-	i=1; // per contare le pagine
-	pt_entry* pte = seg->first_pt_entry;
-	while(i <= seg->npages){ 	
-		if(faultaddress == pte->page){
-			if(pte->in_mem){				// mapping page-frame già presente in page table
-				paddr = pte->frame;
-				
-				vmstats_inc(TLB_RELOAD);
-					
-				if(cm_check_state(paddr,LOADING)){	// il frame è in fase di caricamento: serve sempre il permesso di scrittura	
-					tlbW(faultaddress, paddr, 2);				
-				}
-				else{					// il frame è già stato caricato: servono i permessi corretti
-					tlbW(faultaddress, paddr, seg->permission->write); 
-				}
-				return 0;
-			}
-			else if(pte->in_swap){ 				// frame nello swapfile -> swap_in
-				paddr = frame_alloc(faultaddress, as);
-				if (paddr == 0){			// occorre cercare una vittima tra i frame già allocati e farne swap_out
-					result = handle_victim_and_swapout(as,&paddr,faultaddress);
-					if ( result == EFAULT )
-						return EFAULT;
-				}
-				pte->frame = paddr;
-				pte->in_mem = 1;
-				pte->in_swap = 0; 
-				
-				swap_in(as, faultaddress);
-				
-				vmstats_inc(PAGE_FAULT_SWAP);
-				vmstats_inc(PAGE_FAULT_DISK);
-				
-				cm_update_state(paddr, CLEAN);
-				tlbW(faultaddress, paddr, seg->permission->write); 
-				return 0;
-			}
-			else{ 						// la pagina non è stata ancora caricata in memoria. Alloco un frame e leggo dall'elf.
-				paddr = frame_alloc(faultaddress, as);
-				if (paddr == 0){			// occorre cercare una vittima tra i frame già allocati e farne swap_out.
-					result = handle_victim_and_swapout(as,&paddr,faultaddress);
-					if( result )
-						return EFAULT;
-				}
-				pte->frame = paddr;
-				pte->in_mem = 1;
-				pte->in_swap = 0; 
-
-				bzero((void *)faultaddress, PAGE_SIZE);
-				
-				if(seg->offset < 0){ 			// segmento di stack. Non c'è da fare nessun caricamento
-					cm_update_state(paddr, CLEAN);
-					tlbW(faultaddress, paddr, seg->permission->write);
-					vmstats_inc(PAGE_FAULT_ZERO);	// contatore dei frame azzerati e non caricati da disco
-					return 0;
-				}
-				
-				/*
-				* Calcolo la dimensione del blocco da leggere e l'offset.
-				* Occorre tenere conto dell'eventuale frammentazione iniziale e finale.
-				*/
-				memsz = compute_memsz(seg, i);
-				filesz = memsz;				
-				offset = compute_offset(seg->offset, i);
-				
-				if( i==1){ 				// per la prima pagina è da considerare un eventuale offset iniziale
-					faultaddress = faultaddress + (seg->offset&~PAGE_FRAME);
-				}
+	// pagina cercata: accesso diretto alla page table, i serve solo a calcolare la parte di elf da leggere
+	i = (faultaddress - seg->first_addr)/PAGE_SIZE + 1;	// numero della pagina nel segmento, a partire da 1
+#if OPT_IPT
+	pt_entry ipt_entry = ipt_pte(as, faultaddress, seg->permission->write);	// copia locale: le modifiche non vanno salvate
+	pt_entry* pte = &ipt_entry;
+#else
+	pt_entry* pte = pt_get(as->pt, faultaddress);	// la foglia viene allocata al primo fault del suo blocco da 4MB
+	if(pte == NULL){
+		return ENOMEM;
+	}
+	if(*pte == 0 && seg->permission->write){
+		*pte = PTE_WRITE;			// pagina mai caricata: il permesso di scrittura viene preso dal segmento
+	}
+#endif
 
-				load_page_from_elf(as, faultaddress, offset, memsz, filesz, seg->permission->exec);
+	if(faulttype == VM_FAULT_READONLY && !(*pte & PTE_WRITE)){
+		return EFAULT;				// scrittura su un segmento di sola lettura
+	}
+	// una pagina caricata per una scrittura viene subito considerata modificata: si evita il successivo VM_FAULT_READONLY
+	loaded = (faulttype == VM_FAULT_WRITE && (*pte & PTE_WRITE))? DIRTY : CLEAN;
 
-				vmstats_inc(PAGE_FAULT_ELF);
-				vmstats_inc(PAGE_FAULT_DISK);
-				
-				cm_update_state(paddr, CLEAN);
-				
-				tlbW(faultaddress&PAGE_FRAME, paddr, seg->permission->write); // &PAGE_FRAME per la prima pagina
+	if(PTE_IN_MEM(*pte)){				// mapping page-frame già presente in page table
+		paddr = PTE_PADDR(*pte);
+		
+		spl = splhigh();
+		if(!cm_check_owner(paddr, as, faultaddress)){
+			/*
+			* Il frame è stato scelto come vittima da un altro processo e lo swap out è in corso.
+			* Si riprova dopo aver ceduto la CPU: l'istruzione verrà rieseguita e la pagina sarà nello swapfile.
+			*/
+			splx(spl);
+			thread_yield();
+			return 0;
+		}
+		
+		if(faulttype == VM_FAULT_READONLY){	// prima scrittura su una pagina CLEAN
+			if(!cm_set_dirty(paddr, as, faultaddress, pte, &slot)){
+				splx(spl);
+				thread_yield();
 				return 0;
 			}
+			tlb_set_dirty(faultaddress);
+			stlb_insert(as->stlb_id, faultaddress, *pte);
+			cm_touch(paddr);
+			splx(spl);
+			if(slot >= 0){
+				swap_drop(as, slot);	// la copia nella swap cache non è più aggiornata
+			}
+			return 0;
 		}
-		pte = (pt_entry*)pte->next;
-		i++;
+		
+		vmstats_inc(TLB_RELOAD);
+		cm_policy_stat(REPL_HIT);
+		cm_touch(paddr);			// bit di riferimento per la politica di rimpiazzamento
+			
+		if(cm_check_state(paddr,LOADING)){	// il frame è in fase di caricamento: serve sempre il permesso di scrittura	
+			tlbW(faultaddress, *pte | PTE_DIRTY);				
+		}
+		else{					// il frame è già stato caricato: scrittura permessa solo se già modificato
+			tlbW(faultaddress, *pte); 
+			stlb_insert(as->stlb_id, faultaddress, *pte);
+		}
+		splx(spl);
+		return 0;
+	}
+	else if(faulttype == VM_FAULT_READONLY){
+		return 0;				// la pagina è stata scelta come vittima dopo il fault: l'accesso verrà ripetuto
 	}
+	else if(PTE_IN_EVICTION(*pte)){			// swap out in corso: si riprova quando la pagina sarà nello swapfile
+		thread_yield();
+		return 0;
+	}
+	else if(PTE_IN_SWAP(*pte)){ 			// frame nello swapfile -> swap_in
+		slot = PTE_SLOT(*pte);			// PTE_MAP sovrascrive lo slot con il frame
+		paddr = frame_alloc(faultaddress, as, 0);
+		if (paddr == 0){			// occorre cercare una vittima tra i frame già allocati e farne swap_out
+			result = handle_victim_and_swapout(as,&paddr,faultaddress);
+			if ( result )
+				return result;
+		}
+		*pte = PTE_MAP(*pte, paddr, 1);		// entry definitiva dopo la lettura, quando si sa se lo slot resta
 		
-	if(i>seg->npages){
-		return EFAULT;
+		vaddrs[0] = faultaddress;
+		paddrs[0] = paddr;
+		n = 1 + swap_readahead(as, slot, vaddrs+1, paddrs+1);
+		swap_in(as, slot, vaddrs, paddrs, n, cached);
+		
+		vmstats_inc(PAGE_FAULT_SWAP);
+		vmstats_inc(PAGE_FAULT_DISK);
+		cm_policy_stat(REPL_MISS);
+		
+		/*
+		* Swap cache: una pagina ancora nel suo slot resta CLEAN e, se scelta come vittima prima di essere modificata,
+		* non va riscritta. Con un fault di scrittura la pagina del fault viene modificata subito: lo slot va liberato.
+		*/
+		for(j=0; j<n; j++){
+			if(j == 0 && cached[j] && loaded == DIRTY){
+				swap_drop(as, slot);
+				cached[j] = 0;
+			}
+#if OPT_IPT
+			p = pte;				// nessuna lettura anticipata: n vale 1
+#else
+			p = (j == 0)? pte : pt_lookup(as->pt, vaddrs[j]);
+#endif
+			*p = PTE_MAP(*p, paddrs[j], !cached[j]);
+			if(cached[j]){
+				cm_set_slot(paddrs[j], slot+j);
+			}
+			cm_update_state(paddrs[j], cached[j]? CLEAN : DIRTY);	// DIRTY: senza slot la pagina va riscritta se scelta come vittima
+		}
+		tlbW(faultaddress, *pte); 
+		return 0;
+	}
+	else{ 						// la pagina non è stata ancora caricata in memoria. Alloco un frame e leggo dall'elf.
+		/*
+		* Calcolo la dimensione del blocco da leggere e l'offset.
+		* Occorre tenere conto dell'eventuale frammentazione iniziale e finale e della parte bss.
+		*/
+		memsz = 0;
+		filesz = 0;
+		offset = 0;
+		if(seg->offset >= 0){ 			// per lo stack non c'è da fare nessun caricamento
+			memsz = compute_memsz(seg, i);
+			filesz = compute_filesz(seg, i, memsz);
+			offset = compute_offset(seg->offset, i);
+		}
+		
+		// se il file non copre tutta la pagina il frame deve partire azzerato: viene preso dal pool di frame azzerati
+		paddr = frame_alloc(faultaddress, as, filesz < PAGE_SIZE);
+		if (paddr == 0){			// occorre cercare una vittima tra i frame già allocati e farne swap_out.
+			result = handle_victim_and_swapout(as,&paddr,faultaddress);
+			if( result )
+				return result;
+			if(filesz < PAGE_SIZE){
+				bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+			}
+		}
+		if(filesz == 0){ 			// stack, bss o heap: la pagina è già azzerata
+			*pte = PTE_MAP(*pte, paddr, loaded == DIRTY);
+			cm_update_state(paddr, loaded);
+			tlbW(faultaddress, *pte);
+			vmstats_inc(PAGE_FAULT_ZERO);	// contatore dei frame azzerati e non caricati da disco
+			cm_policy_stat(REPL_MISS);
+			return 0;
+		}
+		
+		/*
+		* La pagina viene letta attraverso l'indirizzo KSEG0 del frame, come in swap_in, e la entry della pt viene scritta
+		* solo a caricamento finito: il refill in assembly non può installare in tlb (anche di altre CPU) una entry
+		* scrivibile di una pagina di sola lettura.
+		*/
+		kvaddr = PADDR_TO_KVADDR(paddr);
+		if( i==1){ 				// per la prima pagina è da considerare un eventuale offset iniziale
+			kvaddr = kvaddr + (seg->offset&~PAGE_FRAME);
+		}
+
+		load_page_from_elf(as, kvaddr, offset, memsz, filesz);
+
+		vmstats_inc(PAGE_FAULT_ELF);
+		vmstats_inc(PAGE_FAULT_DISK);
+		cm_policy_stat(REPL_MISS);
+		
+		cm_update_state(paddr, loaded);
+		
+		*pte = PTE_MAP(*pte, paddr, loaded == DIRTY);
+		tlbW(faultaddress, *pte);
+		return 0;
 	}
 #endif		
 	/* make sure it's page-aligned */
@@ -445,6 +823,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 void vm_shutdown(void){
 #if OPT_FINAL
 	vmstats_print();
+	cm_print_stats();
 	swapspace_shutdown();
 	cm_shutdown();
 #endif
@@ -3,6 +3,8 @@
 #include <synch.h>
 #include <spl.h>
 #include "vm_stats.h"
+#include "coremap.h"
+#include "opt-zswap.h"
 
 
 /* Array contatori per le statistiche */
@@ -22,6 +24,30 @@ static const char *stat_labels[] = {
  /*  7 */ "Page Faults from ELF",
  /*  8 */ "Page Faults from Swapfile",
  /*  9 */ "Swapfile Writes",
+ /* 10 */ "Replacement Hits",
+ /* 11 */ "Replacement Misses",
+ /* 12 */ "Replacement Second Chances",
+ /* 13 */ "Replacement Ghost Hits",
+ /* 14 */ "Reference Bit Sweeps",
+ /* 15 */ "TLB Sweep Invalidations",
+ /* 16 */ "Write Faults on Clean Pages",
+ /* 17 */ "Clean Pages Discarded",
+ /* 18 */ "Pageout Daemon Wakeups",
+ /* 19 */ "Frames Freed by Pageout",
+ /* 20 */ "Synchronous Evictions",
+ /* 21 */ "Zeroed Pool Hits",
+ /* 22 */ "Zeroed Pool Misses",
+ /* 23 */ "Software TLB Hits",
+ /* 24 */ "AS Reactivations Skipped",
+ /* 25 */ "Swapfile Clustered Writes",
+ /* 26 */ "Swapfile Readahead Pages",
+ /* 27 */ "Compressed Pool Stores",
+ /* 28 */ "Compressed Pool Rejects",
+ /* 29 */ "Compressed Pool Hits",
+ /* 30 */ "Compressed Pool Writebacks",
+ /* 31 */ "Compressed Pool Bytes",
+ /* 32 */ "Compression CPU Time (us)",
+ /* 33 */ "Swap Cache Clean Evictions",
 };
 
 /* Azzeramento iniziale array */
@@ -52,6 +78,16 @@ vmstats_inc(unsigned int pos)
     spinlock_release(& stats_lock);
 }
 
+/* Come vmstats_inc, ma aggiunge n al contatore */
+void
+vmstats_add(unsigned int pos, unsigned int n)
+{
+    spinlock_acquire(& stats_lock);
+    KASSERT(pos <  TOT_COUNTERS);
+	stat_counters[pos] += n;
+    spinlock_release(& stats_lock);
+}
+
 /* Funzione per stampa statistiche */
 void vmstats_print(void){
 
@@ -61,6 +97,9 @@ void vmstats_print(void){
 	int sum_pfelf_pfswap = 0;
 	int pf_disk = 0;
 	int i = 0;
+#if OPT_ZSWAP
+	unsigned int zs_avg, zs_in, zs_ops;
+#endif
 /* Calcolo contatori per verifiche */
 	tlb_fault = stat_counters[ TLB_FAULT];
 	sum_tlbfree_tlbreplace = stat_counters[ TLB_FAULT_FREE] + stat_counters[ TLB_FAULT_REPLACE];
@@ -70,9 +109,26 @@ void vmstats_print(void){
 
 /* Stampa statistiche */
 	kprintf("\nVirtual memory statistics:\n");
+	kprintf("VM_STATS %30s = %10s\n", "Replacement Policy", cm_policy_name());
+	kprintf("VM_STATS %30s = %10u\n", "Zeroed Pool Size", cm_zero_pool_size());
 	for (i=0; i< TOT_COUNTERS; i++) {
 		kprintf("VM_STATS %30s = %10d\n", stat_labels[i], stat_counters[i]);
 	}
+	kprintf("VM_STATS %30s = %9u%%\n", "Zeroed Pool Hit Rate",
+		stat_counters[ ZERO_POOL_HIT] + stat_counters[ ZERO_POOL_MISS] ?
+		stat_counters[ ZERO_POOL_HIT]*100 / (stat_counters[ ZERO_POOL_HIT] + stat_counters[ ZERO_POOL_MISS]) : 0);
+#if OPT_ZSWAP
+	/* Rapporto di compressione (byte originali / byte compressi), hit rate sulle pagine lette dallo swap, costo per pagina */
+	zs_avg = stat_counters[ ZSWAP_STORE] ? stat_counters[ ZSWAP_BYTES] / stat_counters[ ZSWAP_STORE] : 0;
+	zs_in = stat_counters[ PAGE_FAULT_SWAP] + stat_counters[ SWAP_READAHEAD_PAGE];
+	zs_ops = stat_counters[ ZSWAP_STORE] + stat_counters[ ZSWAP_REJECT] + stat_counters[ ZSWAP_HIT] + stat_counters[ ZSWAP_WRITEBACK];
+	kprintf("VM_STATS %30s = %7u.%02u\n", "Compressed Pool Ratio",
+		zs_avg ? PAGE_SIZE / zs_avg : 0, zs_avg ? (PAGE_SIZE*100 / zs_avg) % 100 : 0);
+	kprintf("VM_STATS %30s = %9u%%\n", "Compressed Pool Hit Rate",
+		zs_in ? stat_counters[ ZSWAP_HIT]*100 / zs_in : 0);
+	kprintf("VM_STATS %30s = %10u\n", "Compression CPU per Page (us)",
+		zs_ops ? stat_counters[ ZSWAP_USEC] / zs_ops : 0);
+#endif
 	/* Controllo TLB Fault 1 */
 	kprintf("\nVirtual memory checks:\n");
 	kprintf("VM_STATS TLB Faults with Free + TLB Faults with Replace = %d\n", sum_tlbfree_tlbreplace);
@@ -0,0 +1,160 @@
+#include "zswap.h"
+#include <synch.h>
+#include <clock.h>
+#include "vm_stats.h"
+
+static struct lock* zs_lock;		// serializza le compressioni: tabella hash e buffer di uscita sono unici
+static uint16_t* zs_table;		// ultima posizione nella pagina di ogni hash di 3 byte, LZ_NONE se nessuna
+static uint8_t* zs_out;			// ZSWAP_MAX_LEN byte
+
+#define LZ_NONE 0xffff
+#define LZ_MIN 3			// lunghezza minima di una copia
+#define LZ_MAX 18			// lunghezza massima: 4 bit
+#define LZ_WINDOW 4095			// distanza massima: 12 bit
+#define LZ_HASH(p) (((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) * 40543U >> 4) & (ZSWAP_HASH_SIZE-1))
+
+/*
+*	lz_compress - ogni gruppo di 16 elementi è preceduto da una parola di controllo di 16 bit: bit a 1 per una copia
+*		      (2 byte: offset e lunghezza-LZ_MIN), bit a 0 per un byte letterale. Restituisce la lunghezza, 0 se
+*		      supera max.
+*/
+static unsigned int lz_compress(const uint8_t* src, uint8_t* dst, unsigned int max){
+	unsigned int s = 0, d = 0, ctrl = 0, ctrl_pos = 0, nbits = 0, len, off, cand = 0, h;
+
+	for(h=0; h<ZSWAP_HASH_SIZE; h++){
+		zs_table[h] = LZ_NONE;
+	}
+	while(s < PAGE_SIZE){
+		if(nbits == 0){
+			if(d + 2 > max){
+				return 0;
+			}
+			ctrl_pos = d;
+			d += 2;
+			ctrl = 0;
+		}
+		if(d + 2 > max){
+			return 0;
+		}
+		len = 0;
+		if(s + LZ_MIN <= PAGE_SIZE){
+			h = LZ_HASH(src+s);
+			cand = zs_table[h];
+			zs_table[h] = s;
+			if(cand != LZ_NONE && s - cand <= LZ_WINDOW){
+				for(len=0; len<LZ_MAX && s+len<PAGE_SIZE && src[cand+len]==src[s+len]; len++);
+			}
+		}
+		if(len >= LZ_MIN){
+			off = s - cand;
+			dst[d++] = off >> 4;
+			dst[d++] = ((off & 0xf) << 4) | (len - LZ_MIN);
+			ctrl |= 1 << nbits;
+			s += len;
+		}
+		else{
+			dst[d++] = src[s++];
+		}
+		if(++nbits == 16){
+			dst[ctrl_pos] = ctrl & 0xff;
+			dst[ctrl_pos+1] = ctrl >> 8;
+			nbits = 0;
+		}
+	}
+	if(nbits > 0){
+		dst[ctrl_pos] = ctrl & 0xff;
+		dst[ctrl_pos+1] = ctrl >> 8;
+	}
+	return d;
+}
+/*
+*	lz_decompress - le copie possono sovrapporsi alla parte che stanno scrivendo (offset < lunghezza): si copia un byte
+*			alla volta.
+*/
+static void lz_decompress(const uint8_t* src, unsigned int len, uint8_t* dst){
+	unsigned int s = 0, d = 0, ctrl = 0, nbits = 0, off, n;
+
+	while(d < PAGE_SIZE){
+		if(nbits == 0){
+			KASSERT(s + 2 <= len);
+			ctrl = src[s] | (src[s+1] << 8);
+			s += 2;
+			nbits = 16;
+		}
+		if(ctrl & 1){
+			KASSERT(s + 2 <= len);
+			off = (src[s] << 4) | (src[s+1] >> 4);
+			n = (src[s+1] & 0xf) + LZ_MIN;
+			s += 2;
+			KASSERT(off > 0 && off <= d && d + n <= PAGE_SIZE);
+			while(n-- > 0){
+				dst[d] = dst[d-off];
+				d++;
+			}
+		}
+		else{
+			KASSERT(s < len);
+			dst[d++] = src[s++];
+		}
+		ctrl >>= 1;
+		nbits--;
+	}
+	KASSERT(s == len);
+}
+/*
+*	zs_elapsed - microsecondi trascorsi da start, sommati al tempo di CPU del pool (ZSWAP_USEC).
+*/
+static void zs_elapsed(const struct timespec* start){
+	struct timespec now, diff;
+
+	gettime(&now);
+	timespec_sub(&now, start, &diff);
+	vmstats_add(ZSWAP_USEC, diff.tv_sec*1000000 + diff.tv_nsec/1000);
+}
+/*
+*	zswap_bootstrap
+*/
+void zswap_bootstrap(void){
+	zs_lock = lock_create("zswap");
+	zs_table = kmalloc(ZSWAP_HASH_SIZE * sizeof(uint16_t));
+	zs_out = kmalloc(ZSWAP_MAX_LEN);
+	if(zs_lock == NULL || zs_table == NULL || zs_out == NULL){
+		panic("zswap: cannot allocate the compressor\n");
+	}
+}
+/*
+*	zswap_compress - il buffer restituito ha la dimensione esatta della pagina compressa: il pool occupa solo i byte
+*			 compressi (arrotondati dalle classi di kmalloc).
+*/
+unsigned int zswap_compress(paddr_t paddr, void** data){
+	struct timespec start;
+	unsigned int len;
+
+	lock_acquire(zs_lock);
+	gettime(&start);
+	len = lz_compress((const uint8_t *)PADDR_TO_KVADDR(paddr), zs_out, ZSWAP_MAX_LEN);
+	*data = NULL;
+	if(len > 0){
+		*data = kmalloc(len);
+		if(*data != NULL){
+			memcpy(*data, zs_out, len);
+		}
+	}
+	zs_elapsed(&start);
+	lock_release(zs_lock);
+	if(*data == NULL){
+		vmstats_inc(ZSWAP_REJECT);		// incomprimibile o senza memoria: la pagina va su disco
+		return 0;
+	}
+	return len;
+}
+/*
+*	zswap_decompress - non usa lo stato del compressore: nessun lock.
+*/
+void zswap_decompress(const void* data, unsigned int len, void* dst){
+	struct timespec start;
+
+	gettime(&start);
+	lz_decompress(data, len, dst);
+	zs_elapsed(&start);
+}